@@ -4,6 +4,7 @@
 #include "app.hpp"
 #include "shader_A.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <thread>
@@ -19,7 +20,10 @@ app_t::app_t()
 	:world_generator(
 			map_storage,
 			world_buffer)
-	,player(shader_A, world_buffer)
+	,entities(world_buffer)
+	,player(world_buffer, entities)
+	,entities_renderer(shader_A, world_buffer, entities)
+	,frustum_culler(world_buffer)
 	,camera(
             glm::vec3(
                 // 0.0, 100.0, 0.0
@@ -105,6 +109,10 @@ void app_t::loop() {
             color_hex_to_vec3(global_settings.sky_color),
         };
 
+		// Culling overlaps with the priorities calculation
+		frustum_culler.start(camera_frustum,
+				camera.calculate_frustum_x_bounds(get_window_aspect_ratio()));
+
 		for (auto &[buffer_pos_XZ, chunk] : world_buffer.chunks) {
 			const glm::vec3 buffer_pos_XYZ = {
 				static_cast<float>(buffer_pos_XZ.x),
@@ -117,17 +125,24 @@ void app_t::loop() {
                     buffer_pos_XYZ,
                     world_buffer_width,
                     camera);
+			chunk.set_rendering_enabled(false);
+		}
 
-			chunk.draw_cyclicly_if_visible(
+		for (const auto &[chunk, chunk_copy_pos]
+				: frustum_culler.wait()) {
+			chunk->draw_copy(
 				projection_matrix,
 				view_matrix,
 				shader_A_fragment_common_uniforms,
-				buffer_pos_XYZ,
-                world_buffer_width,
-				camera_frustum);
+				chunk_copy_pos);
+			chunk->set_rendering_enabled(true);
 		}
 
-		player.draw_cyclic(projection_matrix, view_matrix, shader_A_fragment_common_uniforms);
+		entities_renderer.draw(
+			projection_matrix,
+			view_matrix,
+			shader_A_fragment_common_uniforms,
+			camera_frustum);
 
 		in_loop_update_imgui();
 
@@ -153,7 +168,7 @@ void app_t::loop() {
 		glfwPollEvents();
 		callbacks_strct.handle_input();
 
-		player.update_physics(delta_time);
+		entities.update_physics(delta_time);
 
 		if (camera.get_following_mode())
 			camera.follow(delta_time,
@@ -217,20 +232,41 @@ void app_t::init_camera() {
 }
 
 void app_t::init_map_related() {
+	// Only the CPU generator is able to generate single tiles
+	const bool stream_map_tiles
+		= global_settings.stream_map_tiles
+		and not global_settings.generate_with_gpu;
+
 	map_storage.load_settings();
 	map_storage.init_gl();
-	map_storage.reallocate_gpu_and_cpu_memory();
+	map_storage.reallocate_gpu_and_cpu_memory(not stream_map_tiles);
 
 	map_generator.load_settings();
 	map_generator.init_gl();
 
 	map_generator.new_seed();
+	if (stream_map_tiles) {
+		map_generator.generate_map_for_tiles();
+		map_tiles.load_settings();
+		map_tiles.set_tile_generator(
+			[this] (int tile_y, int tile_x, uint8_t *content) {
+				map_generator.generate_map_tile(
+					tile_y, tile_x, map_tiles_t::TILE_DIM,
+					map_tiles.get_width(), content);
+			});
+		world_generator.set_map_tiles(&map_tiles);
+		return;
+	}
 	map_generator.generate_map();
 
-	// map_storage.load_from_cpu_to_gpu_memory();
+	// The CPU generator and the GPU emulation already have the map in the
+	// CPU memory. The GPU one
+	// is read back in bands of one chunk row, which init_world_blocks waits
+	// for one at a time.
 	// map_storage.clear();
-	map_storage.load_from_gpu_to_cpu_memory();
-	PRINT_D((int)map_storage.get_component_value(0, 0, 0));
+	if (global_settings.generate_with_gpu
+			and not global_settings.emulate_gpu_on_cpu)
+		map_storage.start_loading_from_gpu_to_cpu_memory(chunk_t::DEPTH);
 }
 
 void app_t::init_world_blocks() {
@@ -243,8 +279,10 @@ void app_t::init_world_blocks() {
 	const int CHUNKS_X_CNT = world_buffer.get_buffer_width();
 	const int CHUNKS_Z_CNT = world_buffer.get_buffer_depth();
     world_generator.load_settings();
-	for (int x = 0; x < CHUNKS_X_CNT; ++x) {
-		for (int z = 0; z < CHUNKS_Z_CNT; ++z) {
+	for (int z = 0; z < CHUNKS_Z_CNT; ++z) {
+		map_storage.wait_for_loaded_rows(
+			std::min((z+1)*chunk_t::DEPTH, map_storage.get_height()));
+		for (int x = 0; x < CHUNKS_X_CNT; ++x) {
 			world_generator.gen_chunk({x, z});
 		}
 	}
@@ -274,7 +312,7 @@ void app_t::init_world_blocks() {
 }
 
 void app_t::init_player() {
-	player.init_gl();
+	entities_renderer.init_gl();
 
 	// player.debug_position = {chunk_t::WIDTH/2.0, chunk_t::HEIGHT, 0.5};
 	// player.debug_position = {chunk_t::WIDTH/2.0, chunk_t::HEIGHT,
@@ -286,6 +324,11 @@ void app_t::init_player() {
     player.debug_position[0] = global_settings.default_player_position[0];
     player.debug_position[1] = global_settings.default_player_position[1];
     player.debug_position[2] = global_settings.default_player_position[2];
+	// The player is never spawned inside of the terrain
+	player.debug_position.y = std::max<float>(player.debug_position.y,
+			world_buffer.get_height(glm::ivec2(
+				std::floor(player.debug_position.x),
+				std::floor(player.debug_position.z))));
 	player.set_position(player.debug_position);
 }
 
@@ -313,5 +356,5 @@ void app_t::deinit_world_blocks() {
 }
 
 void app_t::deinit_player() {
-	player.deinit_gl();
+	entities_renderer.deinit_gl();
 }
@@ -13,11 +13,15 @@
 #include "camera.hpp"
 #include "map_generator/map_storage.hpp"
 #include "map_generator/map_generator.hpp"
+#include "map_generator/map_tiles.hpp"
 #include "shader_A.hpp"
 #include "shader_world.hpp"
 #include "world_buffer.hpp"
 #include "world_generator.hpp"
+#include "entities.hpp"
 #include "player.hpp"
+#include "entities_renderer.hpp"
+#include "frustum_culler.hpp"
 #include "callbacks.hpp"
 
 struct app_t {
@@ -69,7 +73,10 @@ private:
 	shader_world_t shader_world;
 	world_buffer_t world_buffer;
 	world_generator_t world_generator;
+	entities_t entities;
 	player_t player;
+	entities_renderer_t entities_renderer;
+	frustum_culler_t frustum_culler;
 
 	// Camera
 	camera_t camera;
@@ -77,6 +84,7 @@ private:
 	// World map
 	map_storage_t map_storage;
 	map_generator_t map_generator;
+	map_tiles_t map_tiles;
 
 	// Callbacks
 	callbacks_strct_t callbacks_strct;
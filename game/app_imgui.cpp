@@ -272,8 +272,10 @@ void app_t::draw_game_specific_imgui_widgets() {
 
 void app_t::move_player_to_camera() {
     glm::vec3 new_player_pos = camera.get_position();
-    new_player_pos.y = global_settings.terrain_height_in_blocks;
     new_player_pos.z = std::floor(new_player_pos.z) + 0.5f;
+    new_player_pos.y = world_buffer.get_height(glm::ivec2(
+                std::floor(new_player_pos.x),
+                std::floor(new_player_pos.z)));
 
     player.set_position(new_player_pos);
     global_settings.default_player_position[0] = new_player_pos[0];
@@ -167,6 +167,22 @@ frustum_t camera_t::calculate_frustum_planes(float aspect) {
 	return frustum;
 }
 
+glm::vec2 camera_t::calculate_frustum_x_bounds(float aspect) {
+	update_rotation_vectors();
+
+	// Side planes meet at the camera's position, so the frustum lies
+	// within the pyramid spanned by the position and the far corners
+	const float halv_v_side = far_clip_plane_dist * std::tan(glm::radians(fov) * 0.5f);
+	const float half_h_side = halv_v_side * aspect;
+	const float far_x = get_position().x + far_clip_plane_dist * direction_vec.x;
+	const float corner_off_x
+		= std::abs(right_vec.x) * half_h_side + std::abs(up_vec.x) * halv_v_side;
+
+	return glm::vec2(
+		std::min(get_position().x, far_x - corner_off_x),
+		std::max(get_position().x, far_x + corner_off_x));
+}
+
 void camera_t::normalize_cyclic_position() {
     position.x = mod_f(position.x, cyclic_world_width);
 }
@@ -56,6 +56,8 @@ struct camera_t {
 	glm::mat4 calculate_view_matrix();
 	glm::mat4 calculate_projection_matrix(float aspect) const;
 	frustum_t calculate_frustum_planes(float aspect);
+	// Lowest and highest x coordinates of the frustum's corners
+	glm::vec2 calculate_frustum_x_bounds(float aspect);
 
 private:
 	// State
@@ -4,12 +4,13 @@
 #include "chunk.hpp"
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 #include <texture_loader.hpp>
 #include <useful.hpp>
 #include <settings.hpp>
 
-#include "bounding_volume.hpp"
 #include "camera.hpp"
 
 #ifdef _MSC_VER
@@ -61,6 +62,8 @@ chunk_t::chunk_t()
 		for (size_t y = 0; y < HEIGHT; ++y)
 			for (size_t z = 0; z < DEPTH; ++z)
 				content[x][y][z] = block_type::none;
+	std::memset(heights, 0, sizeof(heights));
+	std::memset(ground_heights, 0, sizeof(ground_heights));
 
 	// VAO
 	glGenVertexArrays(1, &vao_id);
@@ -138,19 +141,17 @@ void chunk_t::calculate_preprocessing_priority(
 		buffer_chunk_position_XYZ.y * chunk_t::HEIGHT,
 		buffer_chunk_position_XYZ.z * chunk_t::DEPTH };
 
-    const float A_priority = calculate_single_preprocessing_priority(
-        base_chunk_pos_world_coords_XYZ - glm::vec3(world_buffer_width, 0, 0),
-        camera);
-
-    const float B_priority = calculate_single_preprocessing_priority(
-        base_chunk_pos_world_coords_XYZ,
-        camera);
+    // The nearest copy has the highest priority, only the copies -1, 0
+    // and 1 exist
+    const float off_x = base_chunk_pos_world_coords_XYZ.x + WIDTH * 0.5f
+        - camera.get_position().x;
+    const float copy = std::clamp(
+        -std::round(off_x / world_buffer_width), -1.0f, 1.0f);
 
-    const float C_priority = calculate_single_preprocessing_priority(
-        base_chunk_pos_world_coords_XYZ + glm::vec3(world_buffer_width, 0, 0),
+    preprocessing_priority = calculate_single_preprocessing_priority(
+        base_chunk_pos_world_coords_XYZ
+            + glm::vec3(copy * world_buffer_width, 0, 0),
         camera);
-
-    preprocessing_priority = std::max(std::max(A_priority, B_priority), C_priority);
 }
 
 float chunk_t::calculate_single_preprocessing_priority(
@@ -357,49 +358,11 @@ void chunk_t::draw(
 	glBindVertexArray(0);
 }
 
-void chunk_t::draw_cyclicly_if_visible(
-		const glm::mat4 &projection_matrix,
-		const glm::mat4 &view_matrix,
-        const shader_A_fragment_common_uniforms_t &common_uniforms,
-		const glm::vec3 &buffer_chunk_position_XYZ,
-        const float      world_buffer_width,
-		const frustum_t &camera_frustum) {
-
-	const glm::vec3 base_chunk_pos_world_coords_XYZ = {
-		buffer_chunk_position_XYZ.x * chunk_t::WIDTH,
-		buffer_chunk_position_XYZ.y * chunk_t::HEIGHT,
-		buffer_chunk_position_XYZ.z * chunk_t::DEPTH };
-
-    const bool A_visible = draw_single_copy_if_visible(
-        projection_matrix,
-        view_matrix,
-        common_uniforms,
-        base_chunk_pos_world_coords_XYZ - glm::vec3(world_buffer_width, 0, 0),
-        camera_frustum);
-
-    const bool B_visible = draw_single_copy_if_visible(
-        projection_matrix,
-        view_matrix,
-        common_uniforms,
-        base_chunk_pos_world_coords_XYZ,
-        camera_frustum);
-
-    const bool C_visible = draw_single_copy_if_visible(
-        projection_matrix,
-        view_matrix,
-        common_uniforms,
-        base_chunk_pos_world_coords_XYZ + glm::vec3(world_buffer_width, 0, 0),
-        camera_frustum);
-
-    rendering_enabled_info = A_visible or B_visible or C_visible;
-}
-
-bool chunk_t::draw_single_copy_if_visible(
+void chunk_t::draw_copy(
 		const glm::mat4 &projection_matrix,
 		const glm::mat4 &view_matrix,
         const shader_A_fragment_common_uniforms_t &common_uniforms,
-		const glm::vec3 &chunk_copy_world_position_XYZ,
-		const frustum_t &camera_frustum) {
+		const glm::vec3 &chunk_copy_world_position_XYZ) const {
 
 	const glm::mat4 model_matrix = {
 		{ 1, 0, 0, 0 },
@@ -408,17 +371,9 @@ bool chunk_t::draw_single_copy_if_visible(
 		glm::vec4(chunk_copy_world_position_XYZ, 1.0f)
 	};
 
-	const AABB_t bounding_box(
-		chunk_copy_world_position_XYZ,
-		chunk_copy_world_position_XYZ + static_cast<glm::vec3>(DIMENSIONS));
-
-	if (bounding_box.is_on_frustum(camera_frustum)) {
-		draw(
-			projection_matrix,
-			view_matrix,
-			model_matrix,
-			common_uniforms);
-        return true;
-	} else
-	    return false;
+	draw(
+		projection_matrix,
+		view_matrix,
+		model_matrix,
+		common_uniforms);
 }
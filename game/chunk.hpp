@@ -6,6 +6,7 @@
 #define CHUNK_HPP
 
 #include <vector>
+#include <algorithm>
 
 #include "GL/glew.h"
 #include <GLFW/glfw3.h>
@@ -27,6 +28,11 @@ enum class block_type : uint8_t {
 	cnt
 };
 
+// Ground is formed by the terrain blocks only, not by decorations
+inline bool is_ground_block(block_type type) {
+	return type == block_type::sand or type == block_type::brick;
+}
+
 struct chunk_t {
     // Settings
 	static constexpr int WIDTH = 32;
@@ -59,19 +65,30 @@ struct chunk_t {
         const shader_A_fragment_common_uniforms_t &common_uniforms
 	) const;
 
-	void draw_cyclicly_if_visible(
+	void draw_copy(
 		const glm::mat4 &projection_matrix,
 		const glm::mat4 &view_matrix,
         const shader_A_fragment_common_uniforms_t &common_uniforms,
-		const glm::vec3 &buffer_chunk_position_XYZ,
-        const float      world_buffer_width,
-		const frustum_t &camera_frustum
-	);
+		const glm::vec3 &chunk_copy_world_position_XYZ
+	) const;
+	inline void set_rendering_enabled(bool enabled);
 
+    // Keeps the columns' heights up to date
     inline void set_block(int x, int y, int z, block_type type);
+	// Height of the column is one above its highest block, 0 for empty
+	// columns. These are O(1).
+	inline int get_height(int x, int z) const;
+	inline int get_ground_height(int x, int z) const;
 
     // Fields
 	block_type content[WIDTH][HEIGHT][DEPTH];
+	// Heights of the columns, see `get_height` and `get_ground_height`.
+	// Writing `content` directly requires updating them too.
+	uint8_t heights[WIDTH][DEPTH];
+	uint8_t ground_heights[WIDTH][DEPTH];
+	// Upper bound of the columns' heights, it is not lowered when blocks
+	// are removed
+	uint8_t max_height = 0;
 	// Neighbors order:
 	// 0,  1,  2,  3,  4,  5
 	// -x, +x, -y, +y, -z, +z
@@ -83,13 +100,9 @@ private:
         const glm::vec3 &chunk_copy_world_position_XYZ,
         const camera_t  &camera
     );
-    bool draw_single_copy_if_visible(
-		const glm::mat4 &projection_matrix,
-		const glm::mat4 &view_matrix,
-        const shader_A_fragment_common_uniforms_t &common_uniforms,
-		const glm::vec3 &chunk_copy_world_position_XYZ,
-		const frustum_t &camera_frustum
-        );
+	// Lowers the column's height to the highest block that counts
+	inline void lower_column_height(uint8_t &height, int x, int z,
+			bool (*counts)(block_type));
 
     // Fields
     float preprocessing_priority = 0.0f;
@@ -251,9 +264,40 @@ inline bool chunk_t::is_rendering_enabled() const {
 	return rendering_enabled_info;
 }
 
+inline void chunk_t::set_rendering_enabled(bool enabled) {
+	rendering_enabled_info = enabled;
+}
+
 inline void chunk_t::set_block(int x, int y, int z, block_type type) {
-    if (0 <= x and x < WIDTH and 0 <= y and y < HEIGHT and 0 <= z and z < DEPTH)
-        content[x][y][z] = type;
+    if (not (0 <= x and x < WIDTH and 0 <= y and y < HEIGHT and 0 <= z and z < DEPTH))
+        return;
+    content[x][y][z] = type;
+
+    if (type != block_type::none) {
+        heights[x][z] = std::max<int>(heights[x][z], y+1);
+        max_height = std::max<int>(max_height, y+1);
+    } else if (heights[x][z] == y+1)
+        lower_column_height(heights[x][z], x, z,
+            [] (block_type block) { return block != block_type::none; });
+
+    if (is_ground_block(type))
+        ground_heights[x][z] = std::max<int>(ground_heights[x][z], y+1);
+    else if (ground_heights[x][z] == y+1)
+        lower_column_height(ground_heights[x][z], x, z, is_ground_block);
+}
+
+inline int chunk_t::get_height(int x, int z) const {
+	return heights[x][z];
+}
+
+inline int chunk_t::get_ground_height(int x, int z) const {
+	return ground_heights[x][z];
+}
+
+inline void chunk_t::lower_column_height(uint8_t &height, int x, int z,
+		bool (*counts)(block_type)) {
+	while (height > 0 and not counts(content[x][height-1][z]))
+		--height;
 }
 
 #endif
@@ -0,0 +1,164 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "entities.hpp"
+
+#include <bit>
+#include <algorithm>
+
+entities_t::entities_t(world_buffer_t &world_buffer)
+	:world_buffer{world_buffer}
+{  }
+
+entities_t::entity_id_t entities_t::add(type_t type, glm::vec3 position,
+		glm::vec2 hitbox_dimensions, uint8_t flags) {
+	assert(type < TYPES_CNT);
+	const entity_id_t id = size();
+	position_x.push_back(position.x);
+	position_y.push_back(position.y);
+	position_z.push_back(position.z);
+	velocity_x.push_back(0);
+	velocity_y.push_back(0);
+	offset_x.push_back(0);
+	offset_y.push_back(0);
+	hitbox_x.push_back(hitbox_dimensions.x);
+	hitbox_y.push_back(hitbox_dimensions.y);
+	this->flags.push_back(flags);
+	types.push_back(type);
+	is_unhashed.push_back(false);
+	mark_unhashed(id);
+	max_hitbox_dimensions = glm::max(max_hitbox_dimensions, hitbox_dimensions);
+	return id;
+}
+
+void entities_t::clear() {
+	position_x.clear();
+	position_y.clear();
+	position_z.clear();
+	velocity_x.clear();
+	velocity_y.clear();
+	offset_x.clear();
+	offset_y.clear();
+	hitbox_x.clear();
+	hitbox_y.clear();
+	flags.clear();
+	types.clear();
+	bucket_offsets.clear();
+	bucket_ids.clear();
+	max_hitbox_dimensions = glm::vec2(0, 0);
+	unhashed_ids.clear();
+	is_unhashed.clear();
+}
+
+void entities_t::update_physics(float delta_time) {
+	const std::size_t entities_cnt = size();
+	const float world_width = world_buffer.get_world_width();
+
+	// Gravity and integration
+	float * const vy = velocity_y.data();
+	float * const ox = offset_x.data();
+	float * const oy = offset_y.data();
+	const float * const vx = velocity_x.data();
+	const uint8_t * const f = flags.data();
+	#pragma omp simd
+	for (std::size_t i = 0; i < entities_cnt; ++i) {
+		const float gravity = (f[i] & FLY_MODE) ? 0.0f : GRAVITY;
+		vy[i] -= delta_time * gravity;
+		ox[i] += vx[i] * delta_time;
+		oy[i] += vy[i] * delta_time;
+	}
+
+	// Collisions, entities of a batch are stored next to each other
+	const std::size_t batches_cnt
+		= ceil_div(entities_cnt, COLLISION_BATCH_SIZE);
+	#pragma omp parallel for schedule (dynamic, 1) if (batches_cnt > 1)
+	for (std::size_t batch = 0; batch < batches_cnt; ++batch) {
+		const std::size_t end
+			= std::min(entities_cnt, (batch+1) * COLLISION_BATCH_SIZE);
+		for (std::size_t i = batch * COLLISION_BATCH_SIZE; i < end; ++i) {
+			const glm::vec2 offset(offset_x[i], offset_y[i]);
+			if (offset == glm::vec2(0, 0))
+				continue;
+			offset_x[i] = offset_y[i] = 0;
+
+			glm::vec3 pos(position_x[i], position_y[i], position_z[i]);
+			const glm::bvec2 has_collided = world_buffer.move_XY_rect(
+					pos, glm::vec2(hitbox_x[i], hitbox_y[i]), offset);
+			position_x[i] = mod_f(pos.x, world_width);
+			position_y[i] = pos.y;
+			if (has_collided.x)
+				velocity_x[i] = 0;
+			if (has_collided.y)
+				velocity_y[i] = 0;
+		}
+	}
+
+	rebuild_spatial_hash();
+}
+
+void entities_t::rebuild_spatial_hash() {
+	const std::size_t entities_cnt = size();
+	const std::size_t buckets_cnt
+		= std::bit_ceil(std::max<std::size_t>(entities_cnt*2, 1));
+	buckets_mask = buckets_cnt - 1;
+	cells_x_cnt = std::max(1,
+			world_buffer.get_world_width() / SPATIAL_HASH_CELL_DIM);
+
+	// Counting sort of the ids by buckets
+	std::vector<std::size_t> buckets(entities_cnt);
+	bucket_offsets.assign(buckets_cnt+1, 0);
+	for (std::size_t i = 0; i < entities_cnt; ++i) {
+		buckets[i] = get_bucket(get_cell(get_position(i)));
+		++bucket_offsets[buckets[i]+1];
+	}
+	for (std::size_t i = 0; i < buckets_cnt; ++i)
+		bucket_offsets[i+1] += bucket_offsets[i];
+	bucket_ids.resize(entities_cnt);
+	std::vector<std::size_t> bucket_ends(
+			bucket_offsets.begin(), bucket_offsets.end()-1);
+	for (std::size_t i = 0; i < entities_cnt; ++i)
+		bucket_ids[bucket_ends[buckets[i]]++] = i;
+
+	for (const entity_id_t id : unhashed_ids)
+		is_unhashed[id] = false;
+	unhashed_ids.clear();
+}
+
+void entities_t::find_in_XY_rect(glm::vec3 pos, glm::vec2 dimensions,
+		std::vector<entity_id_t> &ids) const {
+	for (const entity_id_t id : unhashed_ids)
+		if (intersects_XY_rect(id, pos, dimensions))
+			ids.push_back(id);
+	if (bucket_ids.empty())
+		return;
+	const int layer = std::floor(pos.z);
+
+	// Entities are hashed by their positions, so hitboxes reaching into
+	// the rectangle may begin up to the largest hitbox before it
+	const glm::ivec3 beg_cell = get_cell(glm::vec3(
+			glm::vec2(pos) - max_hitbox_dimensions, pos.z));
+	const glm::ivec3 end_cell = get_cell(glm::vec3(
+			glm::vec2(pos) + dimensions, pos.z));
+	int cells_x = end_cell.x - beg_cell.x;
+	if (cells_x < 0)
+		cells_x += cells_x_cnt;
+	cells_x = std::min(cells_x, cells_x_cnt-1);
+
+	for (int dx = 0; dx <= cells_x; ++dx) {
+		const int cell_x = (beg_cell.x + dx) % cells_x_cnt;
+		for (int cell_y = beg_cell.y; cell_y <= end_cell.y; ++cell_y) {
+			const glm::ivec3 cell(cell_x, cell_y, layer);
+			const std::size_t bucket = get_bucket(cell);
+			for (std::size_t j = bucket_offsets[bucket];
+					j < bucket_offsets[bucket+1]; ++j) {
+				const entity_id_t id = bucket_ids[j];
+				// Other cells may share the bucket, unhashed entities
+				// have already been checked
+				if (is_unhashed[id] or get_cell(get_position(id)) != cell)
+					continue;
+				if (intersects_XY_rect(id, pos, dimensions))
+					ids.push_back(id);
+			}
+		}
+	}
+}
@@ -0,0 +1,202 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef ENTITIES_HPP
+#define ENTITIES_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "world_buffer.hpp"
+
+#include <useful.hpp>
+
+// Moving entities stored as a structure of arrays, the id of an entity is
+// its index in every array. Physics of all entities is updated at once:
+// gravity and integration are vectorized, collisions with blocks are
+// resolved for batches of entities in parallel.
+struct entities_t {
+	typedef std::size_t entity_id_t;
+	enum flag_t : uint8_t {
+		// Not affected by gravity
+		FLY_MODE = 1 << 0,
+	};
+	// Entities of the same type share a model
+	enum type_t : uint8_t {
+		PLAYER = 0,
+		TYPES_CNT
+	};
+
+	entities_t(world_buffer_t &world_buffer);
+
+	// `position` - Right-bottom-front corner of the hitbox
+	entity_id_t add(type_t type, glm::vec3 position,
+			glm::vec2 hitbox_dimensions, uint8_t flags = 0);
+	void clear();
+	inline std::size_t size() const;
+
+	inline type_t get_type(entity_id_t id) const;
+	inline glm::vec3 get_position(entity_id_t id) const;
+	// The entity is found by find_in_XY_rect at the new position right
+	// away, it is hashed again in the next physics update
+	inline void set_position(entity_id_t id, glm::vec3 position);
+	inline glm::vec2 get_velocity(entity_id_t id) const;
+	inline void set_velocity(entity_id_t id, glm::vec2 velocity);
+	inline glm::vec2 get_hitbox_dimensions(entity_id_t id) const;
+	inline bool has_flag(entity_id_t id, flag_t flag) const;
+	inline void set_flag(entity_id_t id, flag_t flag, bool enable);
+	// Cumulates offset to apply it in the next physics update
+	inline void queue_offset(entity_id_t id, glm::vec2 offset);
+
+	// Applies gravity, velocities and queued offsets, then rebuilds
+	// the spatial hash
+	void update_physics(float delta_time);
+	// Appends ids of entities, whose hitboxes intersect the XY rectangle
+	// lying in the same z layer
+	void find_in_XY_rect(glm::vec3 pos, glm::vec2 dimensions,
+			std::vector<entity_id_t> &ids) const;
+
+private:
+	static constexpr float GRAVITY = 30.0f;
+	static constexpr std::size_t COLLISION_BATCH_SIZE = 256;
+	// Spatial hash cells span this many blocks along x and y, and a single
+	// z layer
+	static constexpr int SPATIAL_HASH_CELL_DIM = 4;
+
+	void rebuild_spatial_hash();
+	// Unhashed entities are checked one by one by find_in_XY_rect
+	inline void mark_unhashed(entity_id_t id);
+	inline bool intersects_XY_rect(entity_id_t id, glm::vec3 pos,
+			glm::vec2 dimensions) const;
+	inline glm::ivec3 get_cell(glm::vec3 pos) const;
+	inline std::size_t get_bucket(glm::ivec3 cell) const;
+
+	world_buffer_t &world_buffer;
+
+	std::vector<float> position_x;
+	std::vector<float> position_y;
+	std::vector<float> position_z;
+	std::vector<float> velocity_x;
+	std::vector<float> velocity_y;
+	std::vector<float> offset_x;
+	std::vector<float> offset_y;
+	std::vector<float> hitbox_x;
+	std::vector<float> hitbox_y;
+	std::vector<uint8_t> flags;
+	std::vector<type_t> types;
+
+	// Spatial hash: ids of entities are sorted by buckets of the cells
+	// containing their positions, bucket i spans
+	// [bucket_offsets[i], bucket_offsets[i+1]) of bucket_ids
+	std::size_t buckets_mask = 0;
+	int cells_x_cnt = 1;
+	std::vector<std::size_t> bucket_offsets;
+	std::vector<entity_id_t> bucket_ids;
+	glm::vec2 max_hitbox_dimensions = glm::vec2(0, 0);
+	// Entities added or moved by set_position since the spatial hash has
+	// been built, their buckets are out of date
+	std::vector<entity_id_t> unhashed_ids;
+	std::vector<uint8_t> is_unhashed;
+};
+
+inline std::size_t entities_t::size() const {
+	return flags.size();
+}
+
+inline entities_t::type_t entities_t::get_type(entity_id_t id) const {
+	assert(id < size());
+	return types[id];
+}
+
+inline glm::vec3 entities_t::get_position(entity_id_t id) const {
+	assert(id < size());
+	return glm::vec3(position_x[id], position_y[id], position_z[id]);
+}
+
+inline void entities_t::set_position(entity_id_t id, glm::vec3 position) {
+	assert(id < size());
+	position_x[id] = position.x;
+	position_y[id] = position.y;
+	position_z[id] = position.z;
+	mark_unhashed(id);
+}
+
+inline glm::vec2 entities_t::get_velocity(entity_id_t id) const {
+	assert(id < size());
+	return glm::vec2(velocity_x[id], velocity_y[id]);
+}
+
+inline void entities_t::set_velocity(entity_id_t id, glm::vec2 velocity) {
+	assert(id < size());
+	velocity_x[id] = velocity.x;
+	velocity_y[id] = velocity.y;
+}
+
+inline glm::vec2 entities_t::get_hitbox_dimensions(entity_id_t id) const {
+	assert(id < size());
+	return glm::vec2(hitbox_x[id], hitbox_y[id]);
+}
+
+inline bool entities_t::has_flag(entity_id_t id, flag_t flag) const {
+	assert(id < size());
+	return flags[id] & flag;
+}
+
+inline void entities_t::set_flag(entity_id_t id, flag_t flag, bool enable) {
+	assert(id < size());
+	if (enable)
+		flags[id] |= flag;
+	else
+		flags[id] &= ~flag;
+}
+
+inline void entities_t::queue_offset(entity_id_t id, glm::vec2 offset) {
+	assert(id < size());
+	offset_x[id] += offset.x;
+	offset_y[id] += offset.y;
+}
+
+inline void entities_t::mark_unhashed(entity_id_t id) {
+	if (is_unhashed[id])
+		return;
+	is_unhashed[id] = true;
+	unhashed_ids.push_back(id);
+}
+
+inline bool entities_t::intersects_XY_rect(entity_id_t id, glm::vec3 pos,
+		glm::vec2 dimensions) const {
+	if (std::floor(position_z[id]) != std::floor(pos.z)
+			or position_y[id] >= pos.y + dimensions.y
+			or pos.y >= position_y[id] + hitbox_y[id])
+		return false;
+	// Intervals overlap on the cyclic x axis
+	const float world_width = world_buffer.get_world_width();
+	for (const float shift : {-world_width, 0.0f, world_width})
+		if (position_x[id] + shift < pos.x + dimensions.x
+				and pos.x < position_x[id] + shift + hitbox_x[id])
+			return true;
+	return false;
+}
+
+inline glm::ivec3 entities_t::get_cell(glm::vec3 pos) const {
+	glm::ivec3 cell(
+		floor_div(std::floor(pos.x), SPATIAL_HASH_CELL_DIM),
+		floor_div(std::floor(pos.y), SPATIAL_HASH_CELL_DIM),
+		std::floor(pos.z));
+	cell.x %= cells_x_cnt;
+	if (cell.x < 0)
+		cell.x += cells_x_cnt;
+	return cell;
+}
+
+inline std::size_t entities_t::get_bucket(glm::ivec3 cell) const {
+	const std::size_t hash
+		= std::size_t(uint32_t(cell.x)) * 73856093u
+		^ std::size_t(uint32_t(cell.y)) * 19349663u
+		^ std::size_t(uint32_t(cell.z)) * 83492791u;
+	return hash & buckets_mask;
+}
+
+#endif
@@ -0,0 +1,154 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "entities_renderer.hpp"
+
+#include "bounding_volume.hpp"
+#include "texture_loader.hpp"
+
+const glm::vec3 entities_renderer_t::model_dimensions(1, 2, 0);
+
+entities_renderer_t::entities_renderer_t(shader_A_t &shader,
+		world_buffer_t &world_buffer, const entities_t &entities)
+	:shader{shader}
+	,world_buffer{world_buffer}
+	,entities{entities}
+{  }
+
+void entities_renderer_t::init_gl() {
+	// Shared vertices
+	glGenBuffers(1, &positions_buffer_id);
+	glGenBuffers(1, &uvs_buffer_id);
+	glGenBuffers(1, &normals_buffer_id);
+
+	glBindBuffer(GL_ARRAY_BUFFER, positions_buffer_id);
+	glBufferData(GL_ARRAY_BUFFER,
+			sizeof(vertices_positions),
+			vertices_positions, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, uvs_buffer_id);
+	glBufferData(GL_ARRAY_BUFFER,
+			sizeof(vertices_uvs),
+			vertices_uvs, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, normals_buffer_id);
+	glBufferData(GL_ARRAY_BUFFER,
+			sizeof(vertices_normals),
+			vertices_normals, GL_STATIC_DRAW);
+
+	// Per type models
+	for (std::size_t type = 0; type < entities_t::TYPES_CNT; ++type) {
+		type_model_t &model = models[type];
+		model.texture_id = load_texture(textures_paths[type]);
+
+		glGenVertexArrays(1, &model.vao_id);
+		glBindVertexArray(model.vao_id);
+		glGenBuffers(1, &model.positions_instanced_buffer_id);
+
+		// 1rst attribute buffer: vertices
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, positions_buffer_id);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+		// 2nd attribute buffer: UV coordinates
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, uvs_buffer_id);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+		// 3rd attribute buffer: normals
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, normals_buffer_id);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+		// 4th attribute buffer: instances positions, refilled every frame
+		glEnableVertexAttribArray(3);
+		glBindBuffer(GL_ARRAY_BUFFER, model.positions_instanced_buffer_id);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		glVertexAttribDivisor(3, 1);
+	}
+
+	glBindVertexArray(0); // Unbind vao, not necessary
+}
+
+void entities_renderer_t::deinit_gl() {
+	for (type_model_t &model : models) {
+		glDeleteBuffers(1,  &model.positions_instanced_buffer_id);
+		glDeleteTextures(1, &model.texture_id);
+		glDeleteVertexArrays(1, &model.vao_id);
+	}
+
+	glDeleteBuffers(1,  &positions_buffer_id);
+	glDeleteBuffers(1,  &uvs_buffer_id);
+	glDeleteBuffers(1,  &normals_buffer_id);
+}
+
+void entities_renderer_t::collect_instances(const frustum_t &camera_frustum) {
+	for (type_model_t &model : models)
+		model.instances.clear();
+
+	const float world_width = world_buffer.get_world_width();
+	const float copies_offsets[] = { world_width, 0.0f, -world_width };
+	for (entities_t::entity_id_t id = 0; id < entities.size(); ++id) {
+		// The model is centered over the hitbox along x
+		const glm::vec3 pos = entities.get_position(id) + glm::vec3(
+				(model_dimensions.x
+				 - entities.get_hitbox_dimensions(id).x) / -2.0f,
+				0, 0);
+		std::vector<glm::vec3> &instances
+			= models[entities.get_type(id)].instances;
+		for (const float off_x : copies_offsets) {
+			const glm::vec3 instance_pos = pos + glm::vec3(off_x, 0, 0);
+			if (AABB_t(instance_pos, instance_pos + model_dimensions)
+					.is_on_frustum(camera_frustum))
+				instances.push_back(instance_pos);
+		}
+	}
+}
+
+void entities_renderer_t::draw(
+	const glm::mat4 &projection_matrix,
+	const glm::mat4 &view_matrix,
+	const shader_A_fragment_common_uniforms_t &common_uniforms,
+	const frustum_t &camera_frustum
+	) {
+	collect_instances(camera_frustum);
+
+	// Shader
+	glUseProgram(shader.program_id);
+
+	// Set uniforms, instances carry their own translations
+	const glm::mat4 model_matrix(1);
+	glUniformMatrix4fv(shader.model_matrix_uniform,
+			1, GL_FALSE, &model_matrix[0][0]);
+	glUniformMatrix4fv(shader.view_matrix_uniform,
+			1, GL_FALSE, &view_matrix[0][0]);
+	glUniformMatrix4fv(shader.projection_matrix_uniform,
+			1, GL_FALSE, &projection_matrix[0][0]);
+
+	shader.common_fragment_uniforms_locations.send_values(common_uniforms);
+
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(shader.texture_sampler_uniform,
+			0);
+
+	for (const type_model_t &model : models) {
+		if (model.instances.empty())
+			continue;
+
+		// Respecifying the whole buffer lets the driver orphan the storage
+		// used by the previous frame instead of waiting for it
+		glBindBuffer(GL_ARRAY_BUFFER, model.positions_instanced_buffer_id);
+		glBufferData(GL_ARRAY_BUFFER,
+				model.instances.size() * sizeof(glm::vec3),
+				model.instances.data(), GL_STREAM_DRAW);
+
+		glBindTexture(GL_TEXTURE_2D, model.texture_id);
+
+		// Bind VAO and draw
+		glBindVertexArray(model.vao_id);
+		glDrawArraysInstanced(GL_TRIANGLES,
+			0, ARR_SIZE(vertices_positions)/3,
+			model.instances.size()
+		);
+	}
+}
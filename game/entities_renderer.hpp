@@ -0,0 +1,112 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef ENTITIES_RENDERER_HPP
+#define ENTITIES_RENDERER_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "shader_A.hpp"
+#include "world_buffer.hpp"
+#include "entities.hpp"
+
+#include <geometry.hpp>
+#include <useful.hpp>
+#include <settings.hpp>
+
+// Draws all entities of a type with a single instanced call. Every entity
+// is drawn in each of the three cyclic copies of the world, copies outside
+// of the camera frustum are skipped.
+struct entities_renderer_t {
+	entities_renderer_t(shader_A_t &shader, world_buffer_t &world_buffer,
+			const entities_t &entities);
+
+	void init_gl();
+	void deinit_gl();
+	void draw(
+		const glm::mat4 &projection_matrix,
+		const glm::mat4 &view_matrix,
+		const shader_A_fragment_common_uniforms_t &common_uniforms,
+		const frustum_t &camera_frustum
+	);
+
+private:
+	// Fills the instances vectors with positions of the visible copies
+	void collect_instances(const frustum_t &camera_frustum);
+
+	shader_A_t &shader;
+	world_buffer_t &world_buffer;
+	const entities_t &entities;
+
+	// Models of all types share the vertices, types differ in textures
+	GLuint positions_buffer_id;
+	GLuint uvs_buffer_id;
+	GLuint normals_buffer_id;
+
+	struct type_model_t {
+		GLuint texture_id;
+		GLuint vao_id;
+		GLuint positions_instanced_buffer_id;
+		std::vector<glm::vec3> instances;
+	};
+	type_model_t models[entities_t::TYPES_CNT];
+
+	static constexpr const char *textures_paths[entities_t::TYPES_CNT] = {
+		TEXTURE_PLAYER_PATH,
+	};
+
+	// Model space bounds of the vertices below
+	static const glm::vec3 model_dimensions;
+
+	static constexpr float vertices_positions[] = {
+		0, 0, 0,
+		0, 2, 0,
+		1, 0, 0,
+		1, 0, 0,
+		0, 2, 0,
+		1, 2, 0,
+		0, 0, 0,
+		1, 0, 0,
+		0, 2, 0,
+		1, 0, 0,
+		1, 2, 0,
+		0, 2, 0,
+	};
+
+	static constexpr float vertices_uvs[] = {
+		0.5, 1.0,
+		0.5, 0.0,
+		0.0, 1.0,
+		0.0, 1.0,
+		0.5, 0.0,
+		0.0, 0.0,
+		0.5, 1.0,
+		0.0, 1.0,
+		0.5, 0.0,
+		0.0, 1.0,
+		0.0, 0.0,
+		0.5, 0.0,
+	};
+
+	static constexpr float vertices_normals[] = {
+		0,  0, -1,
+		0,  0, -1,
+		0,  0, -1,
+		0,  0, -1,
+		0,  0, -1,
+		0,  0, -1,
+		0,  0,  1,
+		0,  0,  1,
+		0,  0,  1,
+		0,  0,  1,
+		0,  0,  1,
+		0,  0,  1,
+	};
+};
+
+#endif
@@ -0,0 +1,138 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "frustum_culler.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+frustum_culler_t::frustum_culler_t(world_buffer_t &world_buffer)
+	:world_buffer{world_buffer}
+	,worker{&frustum_culler_t::work, this}
+{  }
+
+frustum_culler_t::~frustum_culler_t() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	state_changed.notify_all();
+	worker.join();
+}
+
+void frustum_culler_t::start(const frustum_t &camera_frustum,
+		glm::vec2 visible_x_bounds) {
+	assert(not started);
+	started = true;
+	update_chunks();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested_frustum = camera_frustum;
+		requested_x_bounds = visible_x_bounds;
+		requested = true;
+		culled = false;
+	}
+	state_changed.notify_all();
+}
+
+const std::vector<frustum_culler_t::visible_copy_t>&
+frustum_culler_t::wait() {
+	assert(started);
+	started = false;
+	std::unique_lock<std::mutex> lock(mutex);
+	state_changed.wait(lock, [this] () {
+		return culled;
+	});
+	return visible_copies;
+}
+
+void frustum_culler_t::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		state_changed.wait(lock, [this] () {
+			return requested or quitting;
+		});
+		// A pending request is dropped on destruction
+		if (quitting)
+			return;
+		requested = false;
+		const frustum_t camera_frustum = requested_frustum;
+		const glm::vec2 visible_x_bounds = requested_x_bounds;
+		lock.unlock();
+
+		cull(camera_frustum, visible_x_bounds);
+
+		lock.lock();
+		culled = true;
+		state_changed.notify_all();
+	}
+}
+
+void frustum_culler_t::update_chunks() {
+	world_width = world_buffer.get_world_width();
+	if (chunks.size() == world_buffer.chunks.size())
+		return;
+
+	chunks.clear();
+	chunks_x.clear();
+	chunks_z.clear();
+	for (auto &[buffer_pos_XZ, chunk] : world_buffer.chunks) {
+		chunks.push_back(&chunk);
+		chunks_x.push_back(buffer_pos_XZ.x * chunk_t::WIDTH);
+		chunks_z.push_back(buffer_pos_XZ.y * chunk_t::DEPTH);
+	}
+}
+
+void frustum_culler_t::select_copies(glm::vec2 visible_x_bounds) {
+	boxes_chunks.clear();
+	center_x.clear();
+	center_z.clear();
+	for (std::size_t i = 0; i < chunks.size(); ++i) {
+		// Copy k spans [x + k*W, x + k*W + WIDTH), only the copies
+		// -1, 0 and 1 exist
+		const float x = chunks_x[i];
+		const int k_beg = std::max(-1, static_cast<int>(std::floor(
+				(visible_x_bounds[0] - chunk_t::WIDTH - x) / world_width)) + 1);
+		const int k_end = std::min(1, static_cast<int>(std::ceil(
+				(visible_x_bounds[1] - x) / world_width)) - 1);
+		for (int k = k_beg; k <= k_end; ++k) {
+			boxes_chunks.push_back(i);
+			center_x.push_back(x + k*world_width + chunk_t::WIDTH*0.5f);
+			center_z.push_back(chunks_z[i] + chunk_t::DEPTH*0.5f);
+		}
+	}
+}
+
+void frustum_culler_t::cull(const frustum_t camera_frustum,
+		glm::vec2 visible_x_bounds) {
+	select_copies(visible_x_bounds);
+
+	const std::size_t boxes_cnt = boxes_chunks.size();
+	visible.assign(boxes_cnt, 1);
+	uint8_t * const vis = visible.data();
+	const float * const cx = center_x.data();
+	const float * const cz = center_z.data();
+	const glm::vec3 extents
+		= static_cast<glm::vec3>(chunk_t::DIMENSIONS) * 0.5f;
+
+	for (const plane_t &plane : {
+			camera_frustum.left_face, camera_frustum.right_face,
+			camera_frustum.top_face, camera_frustum.bottom_face,
+			camera_frustum.near_face, camera_frustum.far_face}) {
+		// Every box has the same extents and height, so the projection
+		// interval radius and the y term are shared by all of them
+		const float r = glm::dot(extents, glm::abs(plane.normal));
+		const float nx = plane.normal.x;
+		const float nz = plane.normal.z;
+		const float bound = plane.distance - r - plane.normal.y*extents.y;
+		#pragma omp simd
+		for (std::size_t i = 0; i < boxes_cnt; ++i)
+			vis[i] &= nx*cx[i] + nz*cz[i] >= bound;
+	}
+
+	visible_copies.clear();
+	for (std::size_t i = 0; i < boxes_cnt; ++i)
+		if (vis[i])
+			visible_copies.push_back({chunks[boxes_chunks[i]],
+				glm::vec3(cx[i] - extents.x, 0, cz[i] - extents.z)});
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef FRUSTUM_CULLER_HPP
+#define FRUSTUM_CULLER_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glm/glm.hpp>
+
+#include "chunk.hpp"
+#include "world_buffer.hpp"
+
+#include <geometry.hpp>
+
+// Culls cyclic copies of chunks against the camera frustum. Only copies
+// overlapping the visible interval along x are considered, which is usually
+// a single copy per chunk. Bounding boxes of these copies are kept as
+// a structure of arrays, so that each plane is tested against many boxes
+// at once by vectorized loops. Culling runs on a persistent worker thread
+// between `start` and `wait`.
+struct frustum_culler_t {
+	struct visible_copy_t {
+		chunk_t *chunk;
+		glm::vec3 world_position;
+	};
+
+	frustum_culler_t(world_buffer_t &world_buffer);
+	~frustum_culler_t();
+
+	// `visible_x_bounds` - Lowest and highest x coordinates of the frustum,
+	// in the coordinates of the world copy containing the camera.
+	// Chunks must not be added or removed until `wait` returns.
+	void start(const frustum_t &camera_frustum, glm::vec2 visible_x_bounds);
+	// Returns copies visible in the frustum passed to `start`
+	const std::vector<visible_copy_t>& wait();
+
+private:
+	// Refreshes the chunks' positions if chunks have changed
+	void update_chunks();
+	// Fills the boxes with copies overlapping the visible x interval
+	void select_copies(glm::vec2 visible_x_bounds);
+	void cull(const frustum_t camera_frustum, glm::vec2 visible_x_bounds);
+	// Body of the worker thread, culls once per `start`
+	void work();
+
+	world_buffer_t &world_buffer;
+	float world_width = 0;
+
+	std::vector<chunk_t*> chunks;
+	std::vector<float> chunks_x;
+	std::vector<float> chunks_z;
+
+	// Boxes of the selected copies, all of them have the chunk's dimensions
+	// and lie at the same height
+	std::vector<std::size_t> boxes_chunks;
+	std::vector<float> center_x;
+	std::vector<float> center_z;
+
+	std::vector<uint8_t> visible;
+	std::vector<visible_copy_t> visible_copies;
+
+	// Guards the request and the flags below
+	std::mutex mutex;
+	std::condition_variable state_changed;
+	frustum_t requested_frustum;
+	glm::vec2 requested_x_bounds;
+	bool requested = false;
+	bool culled = false;
+	bool quitting = false;
+	// Touched only by the calling thread
+	bool started = false;
+	// Declared last, so that the thread starts after the members above
+	// are constructed
+	std::thread worker;
+};
+
+#endif
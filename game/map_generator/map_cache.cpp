@@ -0,0 +1,356 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "map_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define MAP_CACHE_USE_MMAP
+#endif
+
+#include <settings.hpp>
+#include <useful.hpp>
+
+namespace {
+
+// Read only view of a whole file, memory mapped where possible
+struct file_view_t {
+	explicit file_view_t(const std::filesystem::path &path);
+	~file_view_t();
+	file_view_t(const file_view_t&) = delete;
+	file_view_t& operator=(const file_view_t&) = delete;
+
+	const uint8_t *data = nullptr;
+	std::size_t size = 0;
+
+private:
+#ifdef MAP_CACHE_USE_MMAP
+	void *mapping = MAP_FAILED;
+#else
+	std::vector<uint8_t> buffer;
+#endif
+};
+
+#ifdef MAP_CACHE_USE_MMAP
+file_view_t::file_view_t(const std::filesystem::path &path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0 and st.st_size > 0) {
+		mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			data = static_cast<const uint8_t*>(mapping);
+			size = st.st_size;
+		}
+	}
+	close(fd);
+}
+
+file_view_t::~file_view_t() {
+	if (mapping != MAP_FAILED)
+		munmap(mapping, size);
+}
+#else
+file_view_t::file_view_t(const std::filesystem::path &path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (not file)
+		return;
+	buffer.resize(file.tellg());
+	file.seekg(0);
+	if (not file.read(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+		return;
+	data = buffer.data();
+	size = buffer.size();
+}
+
+file_view_t::~file_view_t() { }
+#endif
+
+constexpr uint32_t REPEAT_BIT = 0x80000000u;
+constexpr std::size_t MAX_RUN_LENGTH = REPEAT_BIT - 1;
+// Shorter repeats are cheaper to store as literals
+constexpr std::size_t MIN_REPEAT_LENGTH = 3;
+
+inline uint32_t load_word(const uint8_t *p) {
+	uint32_t word;
+	std::memcpy(&word, p, 4);
+	return word;
+}
+
+}
+
+void map_cache_t::load_settings(const settings_t &settings) {
+	max_size_bytes
+		= std::uintmax_t(settings.map_cache_max_size_mb) << 20;
+}
+
+std::filesystem::path map_cache_t::get_entry_path(std::size_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.map",
+			static_cast<unsigned long long>(key));
+	return std::filesystem::path(MAP_CACHE_DIR_PATH) / name;
+}
+
+bool map_cache_t::load(std::size_t key, map_storage_t &map_storage) {
+	const std::filesystem::path path = get_entry_path(key);
+	const int width = map_storage.get_width();
+	const int height = map_storage.get_height();
+	const std::size_t pixels_cnt = std::size_t(width) * height;
+	if (pixels_cnt == 0)
+		return false;
+
+	bool valid = false;
+	{
+		const file_view_t file(path);
+		if (file.data == nullptr)
+			return false;
+
+		header_t header;
+		if (file.size >= sizeof(header)) {
+			std::memcpy(&header, file.data, sizeof(header));
+			uint8_t * const content = map_storage.get_row_pointer(0);
+			const uint8_t * const encoded = file.data + sizeof(header);
+			packed_planes_buffer.resize(pixels_cnt*4);
+			valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+				and header.key == key
+				and header.width == width
+				and header.height == height
+				and header.encoded_size <= file.size - sizeof(header)
+				and header.planes_encoded_size
+					== file.size - sizeof(header) - header.encoded_size
+				and decode(encoded, header.encoded_size,
+						content, pixels_cnt)
+				and calculate_checksum(content, pixels_cnt*4)
+					== header.checksum
+				and decode(encoded + header.encoded_size,
+						header.planes_encoded_size,
+						packed_planes_buffer.data(), pixels_cnt)
+				and calculate_checksum(packed_planes_buffer.data(),
+						pixels_cnt*4) == header.planes_checksum;
+		}
+	}
+
+	std::error_code error;
+	if (not valid) {
+		printf("Removing invalid map cache entry %s\n", path.c_str());
+		std::filesystem::remove(path, error);
+		return false;
+	}
+	unpack_planes(packed_planes_buffer, map_storage);
+	// Marks the entry as the most recently used one
+	std::filesystem::last_write_time(path,
+			std::filesystem::file_time_type::clock::now(), error);
+	return true;
+}
+
+void map_cache_t::store(std::size_t key, map_storage_t &map_storage) {
+	const int width = map_storage.get_width();
+	const int height = map_storage.get_height();
+	const std::size_t pixels_cnt = std::size_t(width) * height;
+	if (pixels_cnt == 0)
+		return;
+	const uint8_t * const content = map_storage.get_row_pointer(0);
+
+	encode(content, pixels_cnt, encoded_buffer);
+	pack_planes(map_storage, packed_planes_buffer);
+	encode(packed_planes_buffer.data(), pixels_cnt, planes_encoded_buffer);
+	header_t header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.key = key;
+	header.width = width;
+	header.height = height;
+	header.encoded_size = encoded_buffer.size() * 4;
+	header.planes_encoded_size = planes_encoded_buffer.size() * 4;
+	header.checksum = calculate_checksum(content, pixels_cnt*4);
+	header.planes_checksum = calculate_checksum(
+			packed_planes_buffer.data(), pixels_cnt*4);
+
+	std::error_code error;
+	std::filesystem::create_directories(MAP_CACHE_DIR_PATH, error);
+	if (error)
+		return;
+
+	// Written under a temporary name, so that a partially written entry
+	// is never read
+	const std::filesystem::path path = get_entry_path(key);
+	std::filesystem::path tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(encoded_buffer.data()),
+				header.encoded_size);
+		file.write(reinterpret_cast<const char*>(planes_encoded_buffer.data()),
+				header.planes_encoded_size);
+		if (not file) {
+			file.close();
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		std::filesystem::remove(tmp_path, error);
+		return;
+	}
+
+	evict_least_recently_used();
+}
+
+void map_cache_t::pack_planes(const map_storage_t &map_storage,
+		std::vector<uint8_t> &packed) {
+	const int width = map_storage.get_width();
+	const int height = map_storage.get_height();
+	packed.resize(std::size_t(width)*height*4);
+	for (int y = 0; y < height; ++y) {
+		const uint16_t *elevation = map_storage.get_elevation_row_pointer(y);
+		const uint8_t *humidity = map_storage.get_humidity_row_pointer(y);
+		const uint8_t *temperature
+			= map_storage.get_temperature_row_pointer(y);
+		uint8_t *word = packed.data() + std::size_t(y)*width*4;
+		for (int x = 0; x < width; ++x, word += 4) {
+			word[0] = elevation[x] & 0xff;
+			word[1] = elevation[x] >> 8;
+			word[2] = humidity[x];
+			word[3] = temperature[x];
+		}
+	}
+}
+
+void map_cache_t::unpack_planes(const std::vector<uint8_t> &packed,
+		map_storage_t &map_storage) {
+	const int width = map_storage.get_width();
+	const int height = map_storage.get_height();
+	assert(packed.size() == std::size_t(width)*height*4);
+	for (int y = 0; y < height; ++y) {
+		uint16_t *elevation = map_storage.get_elevation_row_pointer(y);
+		uint8_t *humidity = map_storage.get_humidity_row_pointer(y);
+		uint8_t *temperature = map_storage.get_temperature_row_pointer(y);
+		const uint8_t *word = packed.data() + std::size_t(y)*width*4;
+		for (int x = 0; x < width; ++x, word += 4) {
+			elevation[x] = uint16_t(word[0]) | uint16_t(word[1]) << 8;
+			humidity[x] = word[2];
+			temperature[x] = word[3];
+		}
+	}
+}
+
+void map_cache_t::evict_least_recently_used() {
+	struct entry_t {
+		std::filesystem::file_time_type time;
+		std::uintmax_t size;
+		std::filesystem::path path;
+	};
+	std::vector<entry_t> entries;
+	std::uintmax_t total_size = 0;
+
+	std::error_code error;
+	for (const auto &dir_entry
+			: std::filesystem::directory_iterator(MAP_CACHE_DIR_PATH, error)) {
+		if (not dir_entry.is_regular_file(error)
+				or dir_entry.path().extension() != ".map")
+			continue;
+		entry_t entry {
+			dir_entry.last_write_time(error),
+			dir_entry.file_size(error),
+			dir_entry.path()
+		};
+		if (error)
+			continue;
+		total_size += entry.size;
+		entries.push_back(std::move(entry));
+	}
+
+	std::sort(entries.begin(), entries.end(),
+		[] (const entry_t &a, const entry_t &b) {
+			return a.time < b.time;
+		});
+	// The newest entry is kept even if it alone exceeds the limit
+	for (std::size_t i = 0;
+			i+1 < entries.size() and total_size > max_size_bytes;
+			++i) {
+		if (std::filesystem::remove(entries[i].path, error))
+			total_size -= entries[i].size;
+	}
+}
+
+uint64_t map_cache_t::calculate_checksum(
+		const uint8_t *data, std::size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (std::size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void map_cache_t::encode(const uint8_t *content, std::size_t pixels_cnt,
+		std::vector<uint32_t> &encoded) {
+	const auto pixel = [content] (std::size_t i) {
+		return load_word(content + i*4);
+	};
+	encoded.clear();
+	std::size_t i = 0;
+	while (i < pixels_cnt) {
+		std::size_t run = 1;
+		while (i+run < pixels_cnt and run < MAX_RUN_LENGTH
+				and pixel(i+run) == pixel(i))
+			++run;
+		if (run >= MIN_REPEAT_LENGTH) {
+			encoded.push_back(REPEAT_BIT | run);
+			encoded.push_back(pixel(i));
+			i += run;
+			continue;
+		}
+
+		// Literal run lasts until a repeat worth encoding begins
+		std::size_t end = i + run;
+		while (end < pixels_cnt and end - i < MAX_RUN_LENGTH
+				and not (end+2 < pixels_cnt
+					and pixel(end) == pixel(end+1)
+					and pixel(end) == pixel(end+2)))
+			++end;
+		end = std::min(end, i + MAX_RUN_LENGTH);
+		encoded.push_back(end - i);
+		for (; i < end; ++i)
+			encoded.push_back(pixel(i));
+	}
+}
+
+bool map_cache_t::decode(const uint8_t *encoded, std::size_t encoded_size,
+		uint8_t *content, std::size_t pixels_cnt) {
+	if (encoded_size % 4 != 0)
+		return false;
+	const std::size_t words_cnt = encoded_size / 4;
+	std::size_t word = 0;
+	std::size_t i = 0;
+	while (word < words_cnt) {
+		const uint32_t run_header = load_word(encoded + word*4);
+		const std::size_t run = run_header & ~REPEAT_BIT;
+		++word;
+		if (run == 0 or run > pixels_cnt - i)
+			return false;
+		if (run_header & REPEAT_BIT) {
+			if (word >= words_cnt)
+				return false;
+			for (std::size_t j = 0; j < run; ++j)
+				std::memcpy(content + (i+j)*4, encoded + word*4, 4);
+			++word;
+		} else {
+			if (run > words_cnt - word)
+				return false;
+			std::memcpy(content + i*4, encoded + word*4, run*4);
+			word += run;
+		}
+		i += run;
+	}
+	return i == pixels_cnt;
+}
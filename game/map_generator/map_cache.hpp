@@ -0,0 +1,69 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef MAP_CACHE_HPP
+#define MAP_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "map_storage.hpp"
+
+// Disk cache of finished maps. Every map lives in its own file named after
+// its key, a hash of the seed and all settings affecting generation.
+// Pixels and the typed planes are run-length encoded and validated with
+// checksums on load.
+// When the cache outgrows its size limit, the least recently used files
+// are removed.
+struct map_cache_t {
+	// Basic usage functions
+	map_cache_t() = default;
+	void load_settings(const settings_t &settings = global_settings);
+	// Returns false if there is no valid entry for the key
+	bool load(std::size_t key, map_storage_t &map_storage);
+	void store(std::size_t key, map_storage_t &map_storage);
+
+private:
+	static constexpr char MAGIC[8] = "WSMAP02";
+	// The encoded pixels are followed by the encoded planes
+	struct header_t {
+		char magic[8];
+		uint64_t key;
+		int32_t width;
+		int32_t height;
+		uint64_t encoded_size;
+		uint64_t planes_encoded_size;
+		// FNV-1a hashes of the decoded pixels and planes
+		uint64_t checksum;
+		uint64_t planes_checksum;
+	};
+
+	std::filesystem::path get_entry_path(std::size_t key) const;
+	// Planes of a pixel are interleaved into a 32-bit word, so that they are
+	// encoded the same way as pixels
+	static void pack_planes(const map_storage_t &map_storage,
+			std::vector<uint8_t> &packed);
+	static void unpack_planes(const std::vector<uint8_t> &packed,
+			map_storage_t &map_storage);
+	void evict_least_recently_used();
+
+	static uint64_t calculate_checksum(const uint8_t *data, std::size_t size);
+	// Every run starts with a 32-bit word, whose highest bit tells whether
+	// the following pixel is repeated, and the rest holds the run's length.
+	// Literal runs are followed by all of their pixels.
+	static void encode(const uint8_t *content, std::size_t pixels_cnt,
+			std::vector<uint32_t> &encoded);
+	// Returns false if the encoded data is malformed
+	static bool decode(const uint8_t *encoded, std::size_t encoded_size,
+			uint8_t *content, std::size_t pixels_cnt);
+
+	std::uintmax_t max_size_bytes = 0;
+	// Reused by load and store
+	std::vector<uint32_t> encoded_buffer;
+	std::vector<uint32_t> planes_encoded_buffer;
+	std::vector<uint8_t> packed_planes_buffer;
+};
+
+#endif
@@ -28,52 +28,45 @@ using namespace glm;
 #include <delaunator.hpp>
 
 // Constructor
-map_generator_t::map_generator_t(map_storage_t * const map_storage)
+map_generator_t::map_generator_t(map_storage_t * const map_storage,
+		const settings_t &settings)
 	:map_storage{map_storage}
+	,settings{settings}
 	,width{map_storage->get_width()}
 	,height{map_storage->get_height()}
-	,get_tour_path_point_x { [this] (const long long id) -> double {
-		const double duplicate_off_x = diagram.space_max_x_duplicate_off;
-		const auto [plane_id, point_id]
-			= floor_div_rem(
-					id,
-					static_cast<long long>(tour_path_points.size()));
-		return
-			tour_path_points[point_id].x
-			+ static_cast<double>(plane_id) * duplicate_off_x;
-	} }
-	,get_tour_path_point_y { [this] (const long long id) -> double {
-		const long long point_id
-			= floor_div_rem(
-					id,
-					static_cast<long long>(tour_path_points.size())).second;
-		return tour_path_points[point_id].y;
-	} }
 {
 	// new_seed();
+	build_generation_graph();
 }
 
 void map_generator_t::load_settings() {
-	voro_cnt = global_settings.voro_cnt;
-	super_voro_cnt = std::min(voro_cnt, global_settings.super_voro_cnt);
+	voro_cnt = settings.voro_cnt;
+	super_voro_cnt = std::min(voro_cnt, settings.super_voro_cnt);
 
 	calculate_constants();
 }
 
 void map_generator_t::calculate_constants() {
-	grid_box_dim_zu = global_settings.map_unit_resolution/4;
+	grid_box_dim_zu = settings.map_unit_resolution/4;
 
 	ratio_wh = double(width)/double(height);
 	ratio_hw = double(height)/double(width);
+	cyclic_map = settings.cyclic_map
+		and not settings.generate_with_gpu;
+	map_single_copy = cyclic_map and not settings.triple_map_size;
+	stored_copies_cnt = map_single_copy ? 1 : 3;
+	map_width = map_single_copy ? width*3 : width;
+	third_width = map_width/3;
+	map_ratio_wh = double(map_width)/double(height);
 	space_max = {ratio_wh, 1};
-	if (global_settings.triple_map_size)
+	if (settings.triple_map_size)
 		space_max.x /= 3.0;
 	real_space_max = {space_max.x*3.0, space_max.y};
 	space_max_x_duplicate_off = space_max.x * 1.0;
 	space_max_duplicate_off_vec = {space_max_x_duplicate_off, 0};
 
 	grid_height = ceil_div(static_cast<size_t>(height), grid_box_dim_zu);
-	grid_width = ceil_div(static_cast<size_t>(width/3), grid_box_dim_zu);
+	grid_width = ceil_div(static_cast<size_t>(third_width), grid_box_dim_zu);
 
 	grid_box_dim_f
 		= static_cast<double>(grid_box_dim_zu)
@@ -88,8 +81,8 @@ void map_generator_t::new_seed() {
 	auto nseed = std::chrono::duration_cast<std::chrono::milliseconds>(
 			std::chrono::system_clock::now().time_since_epoch()
 		).count() / 1;
-	if (global_settings.replace_seed != 0)
-		nseed = global_settings.replace_seed;
+	if (settings.replace_seed != 0)
+		nseed = settings.replace_seed;
 
 	seed_voronoi = nseed;
 	noise.reseed(nseed);
@@ -105,6 +98,11 @@ void map_generator_t::generate_continents(std::mt19937 &gen) {
 	diagram.space_max = real_space_max;
 	diagram.space_max_x_duplicate_off = space_max_x_duplicate_off;
 	diagram.duplicate_off_vec = space_max_duplicate_off_vec;
+	// Neighbors of evenly spread centers lie within a few mean distances
+	// between centers
+	if (cyclic_map)
+		diagram.cyclic_band = CYCLIC_BAND_SPACINGS
+			* std::sqrt(space_max.x*space_max.y / double(voro_cnt));
 	diagram.voronois.assign(voro_cnt, voronoi_t());
 
 	for (voronoi_t &voronoi : diagram.voronois) {
@@ -206,7 +204,7 @@ void map_generator_t::generate_continents(std::mt19937 &gen) {
 		if (super_voro_rep[i] != i)
 			continue;
 
-		if (j <= super_voro_cnt * global_settings.land_probability)
+		if (j <= super_voro_cnt * settings.land_probability)
 			plate.type = plate_t::LAND;
 		else
 			plate.type = plate_t::WATER;
@@ -224,10 +222,17 @@ void map_generator_t::generate_continents(std::mt19937 &gen) {
 
 void map_generator_t::generate_grid_intersections() {
 	using ll = long long;
-	grid.assign(grid_height,
-		std::vector<std::vector<voro_id_t>>(grid_width));
-	for (std::size_t voronoi_id = 0;
-			voronoi_id < diagram.voronois.size(); ++voronoi_id) {
+	struct rect_t {
+		tvec2<ll, highp> min_grid, max_grid;
+		voro_id_t voro_id;
+	};
+	const std::size_t voronois_cnt = diagram.voronois.size();
+	// Every voronoi covers its bounding rectangle and possibly a rectangle
+	// of its duplicate, rects[2*i+1] is empty if there is no duplicate
+	std::vector<rect_t> rects(voronois_cnt * 2);
+
+	#pragma omp parallel for schedule (dynamic, 64)
+	for (std::size_t voronoi_id = 0; voronoi_id < voronois_cnt; ++voronoi_id) {
 		const voronoi_t &voronoi = diagram.voronois[voronoi_id];
 		const std::vector<dvec2> &points = voronoi.points;
 
@@ -242,48 +247,69 @@ void map_generator_t::generate_grid_intersections() {
 			max_replace(max_y, points[i].y);
 		}
 
-		tvec2<ll, highp> min_grid, max_grid;
 		const auto calc_grid_constrains
 			= [
 				this,
-				&min_grid, &max_grid,
 				&min_x, &max_x, &min_y, &max_y
-			] {
-				min_grid = space_to_grid_coords({min_x, min_y});
-				max_grid = space_to_grid_coords({max_x, max_y});
-				min_grid.x = clamp<ll>(min_grid.x, 0, grid_width-1);
-				max_grid.x = clamp<ll>(max_grid.x, 0, grid_width-1);
-				min_grid.y = clamp<ll>(min_grid.y, 0, grid_height-1);
-				max_grid.y = clamp<ll>(max_grid.y, 0, grid_height-1);
+			] (rect_t &rect) {
+				rect.min_grid = space_to_grid_coords({min_x, min_y});
+				rect.max_grid = space_to_grid_coords({max_x, max_y});
+				rect.min_grid.x = clamp<ll>(rect.min_grid.x, 0, grid_width-1);
+				rect.max_grid.x = clamp<ll>(rect.max_grid.x, 0, grid_width-1);
+				rect.min_grid.y = clamp<ll>(rect.min_grid.y, 0, grid_height-1);
+				rect.max_grid.y = clamp<ll>(rect.max_grid.y, 0, grid_height-1);
 			};
 
-		calc_grid_constrains();
-		for (ll y = min_grid.y; y <= max_grid.y; ++y) {
-			for (ll x = min_grid.x; x <= max_grid.x; ++x) {
-				grid[y][x].push_back({voronoi_id, voro_id_t::BASE});
-			}
-		}
+		rect_t &base_rect = rects[2*voronoi_id];
+		base_rect.voro_id = {voronoi_id, voro_id_t::BASE};
+		calc_grid_constrains(base_rect);
 
+		rect_t &duplicate_rect = rects[2*voronoi_id + 1];
+		duplicate_rect.min_grid = {0, 0};
+		duplicate_rect.max_grid = {-1, -1};
 		if (max_x > space_max.x*2.0) {
 			max_replace(min_x, space_max.x*2.0);
 			min_x -= space_max.x*1.0;
 			max_x -= space_max.x*1.0;
-			calc_grid_constrains();
-			for (ll y = min_grid.y; y <= max_grid.y; ++y) {
-				for (ll x = min_grid.x; x <= max_grid.x; ++x) {
-					grid[y][x].push_back({voronoi_id, voro_id_t::LEFT});
-				}
-			}
+			duplicate_rect.voro_id = {voronoi_id, voro_id_t::LEFT};
+			calc_grid_constrains(duplicate_rect);
 		} else if (min_x < space_max.x*1.0) {
 			min_replace(max_x, space_max.x*1.0);
 			min_x += space_max.x*1.0;
 			max_x += space_max.x*1.0;
-			calc_grid_constrains();
-			for (ll y = min_grid.y; y <= max_grid.y; ++y) {
-				for (ll x = min_grid.x; x <= max_grid.x; ++x) {
-					grid[y][x].push_back({voronoi_id, voro_id_t::RIGHT});
-				}
-			}
+			duplicate_rect.voro_id = {voronoi_id, voro_id_t::RIGHT};
+			calc_grid_constrains(duplicate_rect);
+		}
+	}
+
+	// Counting pass, every row of boxes is handled by a single thread
+	grid_offsets.assign(grid_height*grid_width + 1, 0);
+	#pragma omp parallel for schedule (dynamic, 1)
+	for (ll y = 0; y < static_cast<ll>(grid_height); ++y) {
+		std::size_t * const row_cnt = &grid_offsets[y*grid_width + 1];
+		for (const rect_t &rect : rects) {
+			if (y < rect.min_grid.y or y > rect.max_grid.y)
+				continue;
+			for (ll x = rect.min_grid.x; x <= rect.max_grid.x; ++x)
+				++row_cnt[x];
+		}
+	}
+	for (std::size_t i = 0; i < grid_height*grid_width; ++i)
+		grid_offsets[i+1] += grid_offsets[i];
+
+	// Filling pass, rects are visited in the same order as in the counting
+	// pass, so ids in a box are sorted by voronoi id
+	grid_ids.resize(grid_offsets.back());
+	#pragma omp parallel for schedule (dynamic, 1)
+	for (ll y = 0; y < static_cast<ll>(grid_height); ++y) {
+		std::vector<std::size_t> row_fill(
+				grid_offsets.begin() + y*grid_width,
+				grid_offsets.begin() + (y+1)*grid_width);
+		for (const rect_t &rect : rects) {
+			if (y < rect.min_grid.y or y > rect.max_grid.y)
+				continue;
+			for (ll x = rect.min_grid.x; x <= rect.max_grid.x; ++x)
+				grid_ids[row_fill[x]++] = rect.voro_id;
 		}
 	}
 }
@@ -294,7 +320,7 @@ void map_generator_t::generate_grid_intersections() {
 void map_generator_t::generate_joints(
 		std::mt19937 &gen) {
 	using ll = long long;
-	const double R = global_settings.river_joints_R;
+	const double R = settings.river_joints_R;
 	const double RR = R*R;
 	constexpr double SQRT_2 = 1.4142135623730951;
 	const double CELL_DIM = R / SQRT_2;
@@ -302,165 +328,223 @@ void map_generator_t::generate_joints(
 	const double BG_GRID_HEIGHT_F = std::ceil(space_max.y / CELL_DIM);
 	const std::size_t BG_GRID_WIDTH = BG_GRID_WIDTH_F;
 	const std::size_t BG_GRID_HEIGHT = BG_GRID_HEIGHT_F;
-	std::uniform_real_distribution<double> alpha_distrib(0.0, 2.0*M_PI);
-	std::uniform_real_distribution<double> r_distrib(R, 2*R);
 
-	joints.clear();
-	joints.reserve(BG_GRID_WIDTH*BG_GRID_HEIGHT);
-	std::vector<std::size_t> active_list;
-	active_list.reserve(joints.capacity());
-	std::vector<std::vector<std::size_t>> bg_grid(
-		BG_GRID_HEIGHT, std::vector<std::size_t>(
-			BG_GRID_WIDTH, INVALID_ID));
-
-	const auto add_point = [&] (const dvec2 &p) -> bool {
-		const dvec2 grid_p_f = p / CELL_DIM;
-		const dvec2 grid_p_f_floor {
-			std::floor(grid_p_f.x),
-			std::floor(grid_p_f.y)
-		};
-		const tvec2<ll, highp> grid_p {
-			(ll)grid_p_f_floor.x,
-			(ll)grid_p_f_floor.y
-		};
-		if (
-			not (p.x >= 0.0) ||
-			not (p.x <= space_max.x) ||
-			not (p.y >= 0.0) ||
-			not (p.y <= space_max.y)
-		) return false;
-		assert(grid_p_f_floor.x >= 0.0);
-		assert(grid_p_f_floor.x <= BG_GRID_WIDTH_F-1.0);
-		assert(grid_p_f_floor.y >= 0.0);
-		assert(grid_p_f_floor.y <= BG_GRID_HEIGHT_F-1.0);
-		double min_x_f = grid_p_f_floor.x - 2.0;
-		double min_y_f = grid_p_f_floor.y - 2.0;
-		double max_x_f = grid_p_f_floor.x + 2.0;
-		double max_y_f = grid_p_f_floor.y + 2.0;
-		if (grid_p_f.x - grid_p_f_floor.x < 0.5)
-			max_x_f -= 1.0;
-		else min_x_f += 1.0;
-		if (grid_p_f.y - grid_p_f_floor.y < 0.5)
-			max_y_f -= 1.0;
-		else min_y_f += 1.0;
-		if (min_x_f < 0.0) min_x_f -= 1.0;
-		if (max_x_f >= BG_GRID_WIDTH_F-1.0) max_x_f += 1.0;
-		// const ll min_x
-		// 	= (ll)clamp(min_x_f, 0.0, BG_GRID_WIDTH_F-1.0);
-		const ll min_x = min_x_f;
-		const ll min_y
-			= (ll)clamp(min_y_f, 0.0, BG_GRID_HEIGHT_F-1.0);
-		// const ll max_x
-		// 	= (ll)clamp(max_x_f, 0.0, BG_GRID_WIDTH_F-1.0);
-		const ll max_x = max_x_f;
-		const ll max_y
-			= (ll)clamp(max_y_f, 0.0, BG_GRID_HEIGHT_F-1.0);
-		bool distant = true;
-		for (ll x_ = min_x; x_ <= max_x && distant; ++x_) {
-			for (ll y = min_y; y <= max_y && distant; ++y) {
-				dvec2 off(0);
-				ll x = x_;
-				if (x_ < 0) {
-					x = x_ + BG_GRID_WIDTH;
-					off = -space_max_duplicate_off_vec;
-				} else if (x_ > (ll)BG_GRID_WIDTH-1) {
-					x = x_ - BG_GRID_WIDTH;
-					off = space_max_duplicate_off_vec;
-				}
-				assert(in_between_inclusive(0ll, (ll)BG_GRID_WIDTH-1, x));
-				if (bg_grid[y][x] != INVALID_ID) {
-					const dvec2 &q = joints[bg_grid[y][x]];
-					if (len_sq(q+off-p) <= RR)
-						distant = false;
+	// The background grid is split into tiles, every tile is sampled by
+	// a single thread with its own generator and new points are accepted
+	// only in the cells of the sampled tile. Checking a point reads at most
+	// 3 cells around it, so tiles are at least TILE_DIM cells wide and
+	// colored such that tiles of the same color never read cells written
+	// by each other. Colors are processed one after another, hence the
+	// result does not depend on the threads count.
+	constexpr std::size_t TILE_DIM = 8;
+	const std::size_t TILES_X
+		= std::max<std::size_t>(1, BG_GRID_WIDTH / TILE_DIM);
+	const std::size_t TILES_Y
+		= std::max<std::size_t>(1, BG_GRID_HEIGHT / TILE_DIM);
+	// With odd count of tile columns the first and the last one would
+	// have the same color, while being neighbors through the cyclic border
+	const std::size_t COLORS_X = TILES_X > 1 && TILES_X % 2 == 1 ? 3 : 2;
+	const auto tile_color_x = [&] (const std::size_t tile_x) {
+		return COLORS_X == 3 && tile_x == TILES_X-1 ? 2 : tile_x % 2;
+	};
+	const std::mt19937::result_type tiles_seed = gen();
+
+	// Cell is empty if x coordinate of its point is negative
+	std::vector<dvec2> bg_grid(BG_GRID_WIDTH*BG_GRID_HEIGHT, dvec2(-1.0));
+	std::vector<std::vector<dvec2>> tiles_joints(TILES_X*TILES_Y);
+
+	const auto sample_tile = [&] (
+			const std::size_t tile_x, const std::size_t tile_y) {
+		const ll beg_x = tile_x * BG_GRID_WIDTH / TILES_X;
+		const ll end_x = (tile_x+1) * BG_GRID_WIDTH / TILES_X;
+		const ll beg_y = tile_y * BG_GRID_HEIGHT / TILES_Y;
+		const ll end_y = (tile_y+1) * BG_GRID_HEIGHT / TILES_Y;
+		const std::size_t tile_id = tile_y*TILES_X + tile_x;
+		std::seed_seq seq {
+			tiles_seed, static_cast<std::mt19937::result_type>(tile_id) };
+		std::mt19937 tile_gen(seq);
+		std::vector<dvec2> &tile_joints = tiles_joints[tile_id];
+		std::vector<std::size_t> active_list;
+
+		const auto add_point = [&] (const dvec2 &p) -> bool {
+			const dvec2 grid_p_f = p / CELL_DIM;
+			const dvec2 grid_p_f_floor {
+				std::floor(grid_p_f.x),
+				std::floor(grid_p_f.y)
+			};
+			const tvec2<ll, highp> grid_p {
+				(ll)grid_p_f_floor.x,
+				(ll)grid_p_f_floor.y
+			};
+			if (
+				not (p.x >= 0.0) ||
+				not (p.x <= space_max.x) ||
+				not (p.y >= 0.0) ||
+				not (p.y <= space_max.y)
+			) return false;
+			if (
+				grid_p.x < beg_x || grid_p.x >= end_x ||
+				grid_p.y < beg_y || grid_p.y >= end_y
+			) return false;
+			double min_x_f = grid_p_f_floor.x - 2.0;
+			double min_y_f = grid_p_f_floor.y - 2.0;
+			double max_x_f = grid_p_f_floor.x + 2.0;
+			double max_y_f = grid_p_f_floor.y + 2.0;
+			if (grid_p_f.x - grid_p_f_floor.x < 0.5)
+				max_x_f -= 1.0;
+			else min_x_f += 1.0;
+			if (grid_p_f.y - grid_p_f_floor.y < 0.5)
+				max_y_f -= 1.0;
+			else min_y_f += 1.0;
+			if (min_x_f < 0.0) min_x_f -= 1.0;
+			if (max_x_f >= BG_GRID_WIDTH_F-1.0) max_x_f += 1.0;
+			const ll min_x = min_x_f;
+			const ll min_y
+				= (ll)clamp(min_y_f, 0.0, BG_GRID_HEIGHT_F-1.0);
+			const ll max_x = max_x_f;
+			const ll max_y
+				= (ll)clamp(max_y_f, 0.0, BG_GRID_HEIGHT_F-1.0);
+			for (ll x_ = min_x; x_ <= max_x; ++x_) {
+				for (ll y = min_y; y <= max_y; ++y) {
+					dvec2 off(0);
+					ll x = x_;
+					if (x_ < 0) {
+						x = x_ + BG_GRID_WIDTH;
+						off = -space_max_duplicate_off_vec;
+					} else if (x_ > (ll)BG_GRID_WIDTH-1) {
+						x = x_ - BG_GRID_WIDTH;
+						off = space_max_duplicate_off_vec;
+					}
+					assert(in_between_inclusive(0ll, (ll)BG_GRID_WIDTH-1, x));
+					const dvec2 &q = bg_grid[y*BG_GRID_WIDTH + x];
+					if (q.x >= 0.0 && len_sq(q+off-p) <= RR)
+						return false;
 				}
 			}
-		}
-		if (distant) {
-			active_list.push_back(joints.size());
-			bg_grid[grid_p.y][grid_p.x] = joints.size();
-			joints.push_back(p);
-		}
-		return distant;
-	};
-
-	add_point({
-		std::uniform_real_distribution<double>(0.0, space_max.x)(gen),
-		std::uniform_real_distribution<double>(0.0, space_max.y)(gen),
-	});
-
-	while (not active_list.empty()) {
-		const std::size_t id_list = std::uniform_int_distribution<std::size_t>(
-			0, active_list.size()-1)(gen);
-		const dvec2 &p = joints[active_list[id_list]];
+			active_list.push_back(tile_joints.size());
+			bg_grid[grid_p.y*BG_GRID_WIDTH + grid_p.x] = p;
+			tile_joints.push_back(p);
+			return true;
+		};
 
 		constexpr std::size_t MAX_ITERATIONS = 30;
-		std::size_t i = 0;
-		for (; i < MAX_ITERATIONS; ++i) {
-			const double alpha = alpha_distrib(gen);
-			const double r = r_distrib(gen);
-			const dvec2 q = dvec2(
-				std::cos(alpha) * r,
-				std::sin(alpha) * r
-			) + p;
-			if (add_point(q))
+		std::uniform_real_distribution<double> x_distrib(
+				beg_x * CELL_DIM, std::min(end_x * CELL_DIM, space_max.x));
+		std::uniform_real_distribution<double> y_distrib(
+				beg_y * CELL_DIM, std::min(end_y * CELL_DIM, space_max.y));
+		std::uniform_real_distribution<double> alpha_distrib(0.0, 2.0*M_PI);
+		std::uniform_real_distribution<double> r_distrib(R, 2*R);
+		for (std::size_t i = 0; i < MAX_ITERATIONS; ++i)
+			if (add_point({x_distrib(tile_gen), y_distrib(tile_gen)}))
 				break;
+
+		while (not active_list.empty()) {
+			const std::size_t id_list
+				= std::uniform_int_distribution<std::size_t>(
+					0, active_list.size()-1)(tile_gen);
+			const dvec2 p = tile_joints[active_list[id_list]];
+
+			std::size_t i = 0;
+			for (; i < MAX_ITERATIONS; ++i) {
+				const double alpha = alpha_distrib(tile_gen);
+				const double r = r_distrib(tile_gen);
+				const dvec2 q = dvec2(
+					std::cos(alpha) * r,
+					std::sin(alpha) * r
+				) + p;
+				if (add_point(q))
+					break;
+			}
+			if (i == MAX_ITERATIONS) {
+				active_list[id_list] = active_list.back();
+				active_list.pop_back();
+			}
 		}
-		if (i == MAX_ITERATIONS) {
-			active_list[id_list] = active_list.back();
-			active_list.pop_back();
+	};
+
+	std::vector<std::size_t> color_tiles;
+	for (std::size_t color_y = 0; color_y < 2; ++color_y) {
+		for (std::size_t color_x = 0; color_x < COLORS_X; ++color_x) {
+			color_tiles.clear();
+			for (std::size_t tile_y = color_y; tile_y < TILES_Y; tile_y += 2)
+				for (std::size_t tile_x = 0; tile_x < TILES_X; ++tile_x)
+					if (tile_color_x(tile_x) == color_x)
+						color_tiles.push_back(tile_y*TILES_X + tile_x);
+
+			#pragma omp parallel for schedule (dynamic, 1)
+			for (std::size_t i = 0; i < color_tiles.size(); ++i)
+				sample_tile(color_tiles[i] % TILES_X, color_tiles[i] / TILES_X);
 		}
 	}
 
+	std::size_t joints_cnt = 0;
+	for (const std::vector<dvec2> &tile_joints : tiles_joints)
+		joints_cnt += tile_joints.size();
+	joints.clear();
+	joints.reserve(joints_cnt);
+	for (const std::vector<dvec2> &tile_joints : tiles_joints)
+		joints.insert(joints.end(), tile_joints.begin(), tile_joints.end());
+
 	// for (const dvec2 &p : joints) {
 	// 	draw_point(map_storage, p, 0.001, 0x4f4f4f);
 	// 	draw_point(map_storage, p + space_max_duplicate_off_vec, 0.001, 0x4f4f4f);
 	// }
 }
 
+void map_generator_t::calculate_joints_elevation() {
+	const std::size_t joints_cnt = joints.size();
+	joints_elevation.resize(joints_cnt);
+	#pragma omp parallel for schedule (dynamic, 64)
+	for (std::size_t i = 0; i < joints_cnt; ++i)
+		joints_elevation[i]
+			= get_elevation_A(joints[i] + space_max_duplicate_off_vec);
+}
+
 void map_generator_t::generate_rivers(std::mt19937 &gen) {
-	const double R = global_settings.river_joints_R;
+	const double R = settings.river_joints_R;
 	const double RR = R*R;
 	const std::size_t joints_cnt = joints.size();
 	std::uniform_int_distribution<int> probability_distrib(1, 100);
-	al.assign(joints_cnt, {  });
 	joints_humidity.assign(joints_cnt, GREATEST_WATER_DIST);
 
-	std::vector<double> joints_coords(joints_cnt * 2 * 3);
+	std::vector<double> joints_coords(joints_cnt * 2);
 	for (std::size_t i = 0; i < joints_cnt; ++i) {
-		joints_coords[2*i+0 + 0*joints_cnt] = joints[i].x
-			+ 1.0*space_max.x;
-		joints_coords[2*i+1 + 0*joints_cnt] = joints[i].y;
-
-		joints_coords[2*i+0 + 2*joints_cnt] = joints[i].x;
-		joints_coords[2*i+1 + 2*joints_cnt] = joints[i].y;
-
-		joints_coords[2*i+0 + 4*joints_cnt] = joints[i].x
-			+ 2.0*space_max.x;
-		joints_coords[2*i+1 + 4*joints_cnt] = joints[i].y;
+		joints_coords[2*i+0] = joints[i].x + 1.0*space_max.x;
+		joints_coords[2*i+1] = joints[i].y;
 	}
+	// Edges longer than 3R are omitted, so with the cyclic map only joints
+	// twice as close to the border are duplicated
+	const double cyclic_band = cyclic_map ?
+		6.0*R : std::numeric_limits<double>::infinity();
+	std::vector<std::size_t> duplicates_source;
+	const std::size_t left_duplicates_cnt = append_cyclic_copies(
+			joints_coords, joints_cnt, space_max.x, space_max.x,
+			cyclic_band, duplicates_source);
 	const delaunator::Delaunator d(joints_coords);
 
-	for (std::size_t half_edge = 0;
-			half_edge < d.triangles.size();
-			++half_edge) {
-		assert(d.triangles[half_edge] < 3*joints_cnt);
+	// Returns whether the half edge makes an edge of the graph
+	const auto get_edge = [&] (
+			const std::size_t half_edge,
+			std::size_t &p, std::size_t &q,
+			joint_edge_t &e1, joint_edge_t &e2) -> bool {
+		assert(d.triangles[half_edge] < joints_coords.size()/2);
 		const std::size_t next_half_edge
 			= (half_edge % 3 == 2) ? half_edge - 2 : half_edge + 1;
 
-		std::size_t p = d.triangles[half_edge];
-		std::size_t q = d.triangles[next_half_edge];
+		p = d.triangles[half_edge];
+		q = d.triangles[next_half_edge];
 
 		// Omit extreme edges
 		if (d.halfedges[half_edge] == delaunator::INVALID_INDEX)
-			continue;
+			return false;
 
 		// Omit duplicated `p` points
 		if (p >= joints_cnt)
-			continue;
+			return false;
 
 		// Omit duplicated edges
 		if (p > q && d.halfedges[half_edge] != delaunator::INVALID_INDEX)
-			continue;
+			return false;
 
 		// Omit very long edges
 		{
@@ -473,14 +557,13 @@ void map_generator_t::generate_rivers(std::mt19937 &gen) {
 				joints_coords[2*q+1]
 			);
 			if (len_sq(v) > 3*3*RR)
-				continue;
+				return false;
 		}
 
-		joint_edge_t e1, e2;
 		if (q >= joints_cnt) {
-			q -= joints_cnt;
-			if (q >= joints_cnt) {
-				q -= joints_cnt;
+			const std::size_t duplicate_id = q - joints_cnt;
+			q = duplicates_source[duplicate_id];
+			if (duplicate_id >= left_duplicates_cnt) {
 				e1 = {q, joint_edge_t::TO_RIGHT};
 				e2 = {p, joint_edge_t::TO_LEFT};
 			} else {
@@ -491,24 +574,53 @@ void map_generator_t::generate_rivers(std::mt19937 &gen) {
 			e1 = {q, joint_edge_t::USUAL};
 			e2 = {p, joint_edge_t::USUAL};
 		}
-		al[p].push_back(e1);
-		al[q].push_back(e2);
+		return true;
+	};
+
+	// Counting degrees, then filling edges in the same order
+	al_offsets.assign(joints_cnt+1, 0);
+	for (std::size_t half_edge = 0;
+			half_edge < d.triangles.size();
+			++half_edge) {
+		std::size_t p, q;
+		joint_edge_t e1, e2;
+		if (not get_edge(half_edge, p, q, e1, e2))
+			continue;
+		++al_offsets[p+1];
+		++al_offsets[q+1];
+	}
+	for (std::size_t i = 0; i < joints_cnt; ++i)
+		al_offsets[i+1] += al_offsets[i];
+	al_edges.resize(al_offsets[joints_cnt]);
+	{
+		std::vector<std::size_t> al_fill(
+				al_offsets.begin(), al_offsets.end()-1);
+		for (std::size_t half_edge = 0;
+				half_edge < d.triangles.size();
+				++half_edge) {
+			std::size_t p, q;
+			joint_edge_t e1, e2;
+			if (not get_edge(half_edge, p, q, e1, e2))
+				continue;
+			al_edges[al_fill[p]++] = e1;
+			al_edges[al_fill[q]++] = e2;
+		}
 	}
 
-	const int river_start_prob = global_settings.river_start_prob;
-	const int river_branch_prob = global_settings.river_branch_prob;
+	const int river_start_prob = settings.river_start_prob;
+	const int river_branch_prob = settings.river_branch_prob;
 	std::queue<std::size_t> next_v;
 	std::vector<std::size_t> parent(joints_cnt, INVALID_ID);
 	std::vector<dvec2> parent_edge(joints_cnt);
 	for (std::size_t i = 0; i < joints_cnt; ++i) {
 		const dvec2 &p = joints[i] + space_max_duplicate_off_vec;
-		const double A = get_elevation_A(p);
+		const double A = joints_elevation[i];
 		if (A >= 0.5) continue;
 		parent[i] = i;
-		for (joint_edge_t &e : al[i]) {
+		for (joint_edge_t &e : get_joint_edges(i)) {
 			if (parent[e.dest] != INVALID_ID) continue;
 			dvec2 q = joints[e.dest] + space_max_duplicate_off_vec;
-			const double B = get_elevation_A(q);
+			const double B = joints_elevation[e.dest];
 			if (B < 0.5) continue;
 			if (not (probability_distrib(gen) <= river_start_prob)) continue;
 
@@ -529,12 +641,12 @@ void map_generator_t::generate_rivers(std::mt19937 &gen) {
 		const std::size_t v = next_v.front();
 		next_v.pop();
 		const dvec2 &p = joints[v] + space_max_duplicate_off_vec;
-		const double A = get_elevation_A(p);
+		const double A = joints_elevation[v];
 		bool first_child = true;
-		for (joint_edge_t &e : al[v]) {
+		for (joint_edge_t &e : get_joint_edges(v)) {
 			if (parent[e.dest] != INVALID_ID) continue;
 			dvec2 q = joints[e.dest] + space_max_duplicate_off_vec;
-			const double B = get_elevation_A(q);
+			const double B = joints_elevation[e.dest];
 			if (not (A < B + 0.03) || B < 0.5) continue;
 			if ( not first_child &&
 				not (probability_distrib(gen) <= river_branch_prob)) continue;
@@ -561,39 +673,44 @@ void map_generator_t::generate_rivers(std::mt19937 &gen) {
 		}
 	}
 
-	const uint32_t river_color = global_settings.river_color;
+	// Copies of rivers wrap onto the same pixels of the single copy map
+	const uint32_t river_color = settings.river_color;
 	for (std::size_t i = 0; i < joints_cnt; ++i) {
 		const dvec2 A = space_max_duplicate_off_vec + joints[i];
-		for (const joint_edge_t &e : al[i]) {
+		for (const joint_edge_t &e : get_joint_edges(i)) {
 			if (not e.river) continue;
 			const dvec2 B = space_max_duplicate_off_vec + joints[e.dest];
-			if (e.type == joint_edge_t::USUAL)
+			if (e.type == joint_edge_t::USUAL) {
 				draw_edge(
 					A,
 					B,
-					river_color),
-				draw_edge(
-					A - space_max_duplicate_off_vec,
-					B - space_max_duplicate_off_vec,
-					river_color),
-				draw_edge(
-					A + space_max_duplicate_off_vec,
-					B + space_max_duplicate_off_vec,
 					river_color);
+				if (not map_single_copy)
+					draw_edge(
+						A - space_max_duplicate_off_vec,
+						B - space_max_duplicate_off_vec,
+						river_color),
+					draw_edge(
+						A + space_max_duplicate_off_vec,
+						B + space_max_duplicate_off_vec,
+						river_color);
+			}
 			// else if (e.type == joint_edge_t::TO_LEFT)
 			// 	draw_edge(map_storage,
 			// 		A,
 			// 		B - space_max_duplicate_off_vec,
 			// 		river_color);
-			else if (e.type == joint_edge_t::TO_RIGHT)
+			else if (e.type == joint_edge_t::TO_RIGHT) {
 				draw_edge(
 					A,
 					B + space_max_duplicate_off_vec,
-					river_color),
-				draw_edge(
-					A - space_max_duplicate_off_vec,
-					B,
 					river_color);
+				if (not map_single_copy)
+					draw_edge(
+						A - space_max_duplicate_off_vec,
+						B,
+						river_color);
+			}
 		}
 	}
 
@@ -606,11 +723,15 @@ void map_generator_t::generate_rivers(std::mt19937 &gen) {
 }
 
 double map_generator_t::get_temperature(const glm::dvec2 &p) const {
-	double elevation = get_elevation_A(p);
+	return get_temperature(p, get_elevation_A(p));
+}
+
+double map_generator_t::get_temperature(
+		const glm::dvec2 &p, double elevation) const {
 	double temperature = std::abs(space_max.y/2.0 - p.y) / (space_max.y/2.0);
 	temperature = 1.0 - temperature;
 	temperature = 1.0 - std::pow(1.0 - temperature,
-			global_settings.temperature_exp);
+			settings.temperature_exp);
 
 	temperature = 0.6 * temperature + 0.4;
 	elevation = (clamp(elevation, 0.5, 1.0) - 0.5) * 2.0;
@@ -622,12 +743,11 @@ double map_generator_t::get_temperature(const glm::dvec2 &p) const {
 
 void map_generator_t::calculate_climate() {
 	const std::size_t joints_cnt = joints.size();
-	const int humidity_scale = global_settings.humidity_scale;
+	const int humidity_scale = settings.humidity_scale;
 
 	std::queue<std::size_t> next_v;
 	for (std::size_t v = 0; v < joints_cnt; ++v) {
-		const dvec2 p = joints[v] + space_max_duplicate_off_vec;
-		const double elevation = get_elevation_A(p);
+		const double elevation = joints_elevation[v];
 		if (elevation < 0.5 || joints_humidity[v] == 0) {
 			joints_humidity[v] = 0;
 			next_v.push(v);
@@ -637,54 +757,169 @@ void map_generator_t::calculate_climate() {
 	while (not next_v.empty()) {
 		const std::size_t v = next_v.front();
 		next_v.pop();
-		for (const joint_edge_t &e : al[v]) {
+		for (const joint_edge_t &e : get_joint_edges(v)) {
 			if (!min_replace(joints_humidity[e.dest], joints_humidity[v]+1))
 				continue;
 			next_v.push(e.dest);
 		}
 	}
 
+	const bool draw_climate
+		= settings.draw_humidity or settings.draw_temperature;
+	std::vector<uint8_t> humidity_values(joints_cnt);
+	std::vector<uint8_t> temperature_values(joints_cnt);
 	for (std::size_t v = 0; v < joints_cnt; ++v) {
 		const dvec2 p = joints[v] + space_max_duplicate_off_vec;
 
 		float humidity = (float)joints_humidity[v] / (float)humidity_scale;
 		min_replace(humidity, 1.0f);
-		const double temperature = get_temperature(p);
+		const double temperature = get_temperature(p, joints_elevation[v]);
+		humidity_values[v] = humidity * 255.0f;
+		temperature_values[v] = temperature * 255.0;
 
+		if (not draw_climate)
+			continue;
 		double hue = 0;
-		if (global_settings.draw_humidity)
+		if (settings.draw_humidity)
 			hue = humidity * 120.0 / 360.0 + 240.0 / 360.0;
-		else if (global_settings.draw_temperature)
+		else if (settings.draw_temperature)
 			hue = (1.0 - temperature) * 300.0 / 360.0;
 
 		const uint32_t color = hsv_to_rgb(hue, 0.67f, 0.86f);
 		draw_point(p, 0.03, color);
 	}
+	fill_climate_planes(humidity_values, temperature_values);
+}
+
+void map_generator_t::fill_climate_planes(
+		const std::vector<uint8_t> &humidity_values,
+		const std::vector<uint8_t> &temperature_values) {
+	using ll = long long;
+	const std::size_t joints_cnt = joints.size();
+	if (joints_cnt == 0) {
+		map_storage->clear_climate_planes();
+		return;
+	}
+
+	// Joints are sorted by cells of a grid spanning the not tripled space,
+	// the cells are about as large as the distance between joints
+	const ll cells_x = std::max(1.0,
+			std::ceil(space_max.x / settings.river_joints_R));
+	const ll cells_y = std::max(1.0,
+			std::ceil(space_max.y / settings.river_joints_R));
+	const dvec2 cell_dim(space_max.x / cells_x, space_max.y / cells_y);
+	const auto get_cell = [&] (const dvec2 &p) {
+		return tvec2<ll, highp>(
+			clamp<ll>(std::floor(p.x / cell_dim.x), 0, cells_x-1),
+			clamp<ll>(std::floor(p.y / cell_dim.y), 0, cells_y-1));
+	};
+	std::vector<std::size_t> cell_offsets(cells_x*cells_y + 1, 0);
+	std::vector<std::size_t> cells(joints_cnt);
+	for (std::size_t v = 0; v < joints_cnt; ++v) {
+		const tvec2<ll, highp> cell = get_cell(joints[v]);
+		cells[v] = cell.y*cells_x + cell.x;
+		++cell_offsets[cells[v]+1];
+	}
+	for (std::size_t i = 0; i+1 < cell_offsets.size(); ++i)
+		cell_offsets[i+1] += cell_offsets[i];
+	std::vector<std::size_t> cell_joints(joints_cnt);
+	std::vector<std::size_t> cell_ends(
+			cell_offsets.begin(), cell_offsets.end()-1);
+	for (std::size_t v = 0; v < joints_cnt; ++v)
+		cell_joints[cell_ends[cells[v]]++] = v;
+
+	// Rings of cells around the pixel's cell are searched, until they lie
+	// further than the nearest joint found so far
+	const auto find_nearest_joint = [&] (const dvec2 &p) {
+		const tvec2<ll, highp> cell = get_cell(p);
+		const double min_cell_dim = std::min(cell_dim.x, cell_dim.y);
+		std::size_t nearest = 0;
+		double nearest_dist_sq = std::numeric_limits<double>::infinity();
+		for (ll r = 0; ; ++r) {
+			const double ring_dist = (r-1) * min_cell_dim;
+			if (r > 1 and ring_dist*ring_dist >= nearest_dist_sq)
+				break;
+			// Every cell has been searched
+			if (r > std::max(cells_x, cells_y))
+				break;
+			for (ll dy = -r; dy <= r; ++dy) {
+				const ll y = cell.y + dy;
+				if (y < 0 || y >= cells_y)
+					continue;
+				// Only the borders of the ring are new
+				const ll step_x = (dy == -r || dy == r) ? 1 : 2*r;
+				for (ll dx = -r; dx <= r; dx += step_x) {
+					ll x = cell.x + dx;
+					dvec2 off(0);
+					if (cyclic_map) {
+						const auto [wraps, wrapped_x]
+							= floor_div_rem(x, cells_x);
+						x = wrapped_x;
+						off.x = wraps * space_max.x;
+					} else if (x < 0 || x >= cells_x) {
+						continue;
+					}
+					const std::size_t c = y*cells_x + x;
+					for (std::size_t i = cell_offsets[c];
+							i < cell_offsets[c+1]; ++i) {
+						const std::size_t v = cell_joints[i];
+						if (min_replace(nearest_dist_sq,
+								len_sq(joints[v] + off - p)))
+							nearest = v;
+					}
+				}
+			}
+		}
+		return nearest;
+	};
+
+	#pragma omp parallel for schedule (dynamic, 8)
+	for (int y = 0; y < height; ++y) {
+		uint8_t * const humidity_row = map_storage->get_humidity_row_pointer(y);
+		uint8_t * const temperature_row
+			= map_storage->get_temperature_row_pointer(y);
+		// Other copies of the map take the values of the first one
+		for (int x = 0; x < width; ++x) {
+			if (x >= third_width) {
+				humidity_row[x] = humidity_row[x % third_width];
+				temperature_row[x] = temperature_row[x % third_width];
+				continue;
+			}
+			const dvec2 p = map_to_space_coords(dvec2(x + third_width, y))
+				- space_max_duplicate_off_vec;
+			const std::size_t v = find_nearest_joint(p);
+			humidity_row[x] = humidity_values[v];
+			temperature_row[x] = temperature_values[v];
+		}
+	}
 }
 
 double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 	auto grid_p = space_to_grid_coords(p);
 	min_replace<long long>(grid_p.x, grid_width-1);
 	min_replace<long long>(grid_p.y, grid_height-1);
-	const std::vector<voro_id_t> &vec
-		= grid[grid_p.y][grid_p.x];
+	const std::size_t box_id = grid_p.y*grid_width + grid_p.x;
+	const voro_id_t * const box_beg = grid_ids.data() + grid_offsets[box_id];
+	const voro_id_t * const box_end = grid_ids.data() + grid_offsets[box_id+1];
 
-	assert(vec.size() > 0);
+	assert(box_end > box_beg);
 
 	voro_id_t closest_voro_id;
 	double closest_dist_sq = std::numeric_limits<double>::max();
 	dvec2 closest_voro_center;
-	for (std::size_t i = 0; i < vec.size(); ++i) {
-		const voro_id_t voro_id = vec[i];
-		const dvec2 voro_center
-			= diagram.voronois[voro_id.id].center
-			+ (
-				vec[i].type == voro_id_t::LEFT ?
+	dvec2 closest_voro_off;
+	for (const voro_id_t *it = box_beg; it != box_end; ++it) {
+		const voro_id_t voro_id = *it;
+		const dvec2 voro_off
+			= (
+				voro_id.type == voro_id_t::LEFT ?
 				-diagram.duplicate_off_vec :
-				vec[i].type == voro_id_t::RIGHT ?
+				voro_id.type == voro_id_t::RIGHT ?
 				diagram.duplicate_off_vec :
 				dvec2(0)
 			);
+		const dvec2 voro_center
+			= diagram.voronois[voro_id.id].center + voro_off;
 
 		const double new_dist_sq
 			= len_sq(p - voro_center);
@@ -692,18 +927,10 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 			closest_voro_id = voro_id;
 			closest_dist_sq = new_dist_sq;
 			closest_voro_center = voro_center;
+			closest_voro_off = voro_off;
 		}
 	}
 	const voronoi_t &voro = diagram.voronois[closest_voro_id.id];
-	const double closest_voronoi_dist_sq = closest_dist_sq;
-	const dvec2 closest_voro_off
-		= (
-			closest_voro_id.type == voro_id_t::LEFT ?
-			-diagram.duplicate_off_vec :
-			closest_voro_id.type == voro_id_t::RIGHT ?
-			diagram.duplicate_off_vec :
-			dvec2(0)
-		);
 
 	std::size_t triangle_neighbor_edge_id = INVALID_ID;
 	for (std::size_t i = 0;
@@ -726,6 +953,26 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 	}
 	assert(voro.clipped || triangle_neighbor_edge_id != INVALID_ID);
 
+	return get_elevation_A_in_wedge(
+		p, closest_voro_id, triangle_neighbor_edge_id);
+}
+
+double map_generator_t::get_elevation_A_in_wedge(
+		const glm::dvec2 &p,
+		const voro_id_t closest_voro_id,
+		const std::size_t triangle_neighbor_edge_id) const {
+	const voronoi_t &voro = diagram.voronois[closest_voro_id.id];
+	const dvec2 closest_voro_off
+		= (
+			closest_voro_id.type == voro_id_t::LEFT ?
+			-diagram.duplicate_off_vec :
+			closest_voro_id.type == voro_id_t::RIGHT ?
+			diagram.duplicate_off_vec :
+			dvec2(0)
+		);
+	const dvec2 closest_voro_center = voro.center + closest_voro_off;
+	const double closest_voronoi_dist_sq = len_sq(p - closest_voro_center);
+
 	// Calculating elevation
 	plate_t::type_t pixel_type = plates[closest_voro_id.id].type;
 	double elevation = 0.0;
@@ -748,31 +995,8 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 		const double closest_voro_dist
 			= std::sqrt(closest_voronoi_dist_sq);
 
-		plate_t::type_t prev_type = plate_t::NONE;
-		plate_t::type_t nxt_type  = plate_t::NONE;
-		std::size_t prev = triangle_neighbor_edge_id;
-		std::size_t nxt = triangle_neighbor_edge_id;
-		{
-			if (triangle_neighbor_edge_id == INVALID_ID) {
-				prev = voro.al.size()-1;
-				nxt = 0;
-			} else {
-				if (prev == 0) {
-					if (voro.clipped) prev = INVALID_ID;
-					else prev = voro.al.size()-1;
-				} else
-					--prev;
-				if (nxt == voro.al.size()-1) {
-					if (voro.clipped) nxt = INVALID_ID;
-					else nxt = 0;
-				} else ++nxt;
-			}
-
-			if (prev != INVALID_ID)
-				prev_type = plates[voro.al[prev].neighbor_id].type;
-			if (nxt != INVALID_ID)
-				nxt_type = plates[voro.al[nxt].neighbor_id].type;
-		}
+		const auto [prev_type, nxt_type]
+			= get_adjacent_edges_types(voro, triangle_neighbor_edge_id);
 
 		if (plates[closest_voro_id.id].type
 			!= plates[triangle_neighbor_id].type
@@ -808,23 +1032,8 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 				pixel_type = plate_t::COAST;
 		}
 
-		if (plates[closest_voro_id.id].type == plate_t::LAND) {
-			elevation /= 2.0;
-			elevation += 0.5;
-		} else {
-			elevation = 1.0 - elevation;
-			elevation /= 2.0;
-		}
-		if (pixel_type == plate_t::COAST) {
-			constexpr double A = 0.2;
-			constexpr double B = 0.9;
-			if (elevation <= A)
-				pixel_type = plate_t::WATER;
-			if (elevation >= B)
-				pixel_type = plate_t::LAND;
-			elevation -= A;
-			elevation /= (B-A);
-		}
+		scale_wedge_elevation_A(
+				plates[closest_voro_id.id].type, pixel_type, elevation);
 
 		// if (debug_vals[1] % 2 == 1) {
 		// 	pixel_type = plate_t::COAST;
@@ -836,6 +1045,62 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 		elevation = 0;
 	}
 
+	return get_noised_elevation_A(p, pixel_type, elevation);
+}
+
+std::pair<map_generator_t::plate_t::type_t, map_generator_t::plate_t::type_t>
+map_generator_t::get_adjacent_edges_types(
+		const voronoi_t &voro, const std::size_t edge_id) const {
+	plate_t::type_t prev_type = plate_t::NONE;
+	plate_t::type_t nxt_type  = plate_t::NONE;
+	std::size_t prev = edge_id;
+	std::size_t nxt = edge_id;
+	if (edge_id == INVALID_ID) {
+		prev = voro.al.size()-1;
+		nxt = 0;
+	} else {
+		if (prev == 0) {
+			if (voro.clipped) prev = INVALID_ID;
+			else prev = voro.al.size()-1;
+		} else
+			--prev;
+		if (nxt == voro.al.size()-1) {
+			if (voro.clipped) nxt = INVALID_ID;
+			else nxt = 0;
+		} else ++nxt;
+	}
+
+	if (prev != INVALID_ID)
+		prev_type = plates[voro.al[prev].neighbor_id].type;
+	if (nxt != INVALID_ID)
+		nxt_type = plates[voro.al[nxt].neighbor_id].type;
+	return {prev_type, nxt_type};
+}
+
+void map_generator_t::scale_wedge_elevation_A(
+		const plate_t::type_t plate_type,
+		plate_t::type_t &pixel_type, double &elevation) const {
+	if (plate_type == plate_t::LAND) {
+		elevation /= 2.0;
+		elevation += 0.5;
+	} else {
+		elevation = 1.0 - elevation;
+		elevation /= 2.0;
+	}
+	if (pixel_type == plate_t::COAST) {
+		constexpr double A = 0.2;
+		constexpr double B = 0.9;
+		if (elevation <= A)
+			pixel_type = plate_t::WATER;
+		if (elevation >= B)
+			pixel_type = plate_t::LAND;
+		elevation -= A;
+		elevation /= (B-A);
+	}
+}
+
+double map_generator_t::get_noised_elevation_A(const glm::dvec2 &p,
+		const plate_t::type_t pixel_type, double elevation) const {
 	if (pixel_type == plate_t::WATER)
 		elevation = 0;
 	else if (pixel_type == plate_t::LAND)
@@ -860,6 +1125,323 @@ double map_generator_t::get_elevation_A(const glm::dvec2 &p) const {
 	return noised_elevation;
 }
 
+map_generator_t::elevation_A_pixel_t map_generator_t::get_elevation_A_pixel(
+		double elevation_A) const {
+	assert(in_between_inclusive(0.0, 1.0, elevation_A));
+
+	uint32_t color;
+	if (elevation_A < 0.5)
+		elevation_A = 0.15 + 0.25 * elevation_A;
+	else
+		elevation_A = 0.0 + 1.0 * elevation_A;
+
+	color = hsv_to_rgb(
+		(1.0 - elevation_A) * 240.0 / 360.0, 0.6, 0.8);
+
+	const uint8_t elevation_A_byte = elevation_A * 255.0;
+	const uint16_t elevation
+		= elevation_A * double(map_storage_t::MAX_ELEVATION);
+	return {color, elevation_A_byte, elevation};
+}
+
+void map_generator_t::draw_elevation_A_pixel(
+		const int y, const int x, double elevation_A) {
+	const auto [color, elevation_A_byte, elevation]
+		= get_elevation_A_pixel(elevation_A);
+
+	for (int copy = 0; copy < stored_copies_cnt; ++copy) {
+		const int storage_x = x + width*copy/stored_copies_cnt;
+		map_storage->set_rgb_value(y, storage_x, color);
+		map_storage->get_component_reference(y, storage_x, 3)
+			= elevation_A_byte;
+		map_storage->get_elevation_reference(y, storage_x) = elevation;
+	}
+}
+
+void map_generator_t::rasterize_voronoi_wedges() {
+	// Every visible edge of every voronoi copy (base, left and right) spans
+	// a triangle (wedge) with the voronoi center. Wedges are bucketed into
+	// bands of rows, then each band is scanned by a single thread: for
+	// every row the x span of a wedge is computed from its three half
+	// planes, so only pixels lying in the wedge are visited. The plate
+	// types are known per wedge, and the geometric term of the elevation
+	// is linear in the pixel's position, so it is stepped along the span.
+	// Pixels closer than BORDER_EPS to a wedge's border, where
+	// get_elevation_A breaks ties on its own, and pixels not covered by
+	// any wedge (corners of clipped polygons) fall back to get_elevation_A.
+	struct wedge_t {
+		voro_id_t voro_id;
+		std::size_t edge_id;
+		int min_y, max_y;
+	};
+	constexpr double BORDER_EPS = 1e-9;
+	constexpr int BAND_HEIGHT = 8;
+	const int bands_cnt = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	const double x_space_to_map = double(map_width-1) / (3.0*space_max.x);
+	const double x_space_to_map_inv = (3.0*space_max.x) / double(map_width-1);
+	const double y_space_to_map = double(height-1) / space_max.y;
+
+	std::vector<wedge_t> wedges;
+	for (std::size_t i = 0; i < voro_cnt; ++i) {
+		const voronoi_t &voro = diagram.voronois[i];
+		for (const voro_id_t::type_t type
+				: {voro_id_t::BASE, voro_id_t::LEFT, voro_id_t::RIGHT}) {
+			const dvec2 off
+				= (
+					type == voro_id_t::LEFT ?
+					-diagram.duplicate_off_vec :
+					type == voro_id_t::RIGHT ?
+					diagram.duplicate_off_vec :
+					dvec2(0)
+				);
+			const dvec2 center = voro.center + off;
+			for (std::size_t j = 0; j < voro.al.size(); ++j) {
+				const voronoi_t::edge_t &edge = voro.al[j];
+				if (not edge.visible)
+					continue;
+				const dvec2 beg = edge.beg + off;
+				const dvec2 end = edge.end + off;
+
+				const double min_x = std::min({center.x, beg.x, end.x})
+					* x_space_to_map;
+				const double max_x = std::max({center.x, beg.x, end.x})
+					* x_space_to_map;
+				if (max_x < third_width-1 or min_x > 2*third_width)
+					continue;
+
+				const double min_y = std::min({center.y, beg.y, end.y})
+					* y_space_to_map;
+				const double max_y = std::max({center.y, beg.y, end.y})
+					* y_space_to_map;
+				wedge_t wedge {
+					voro_id_t{i, type},
+					j,
+					std::max(0, static_cast<int>(std::floor(min_y))),
+					std::min(height-1, static_cast<int>(std::ceil(max_y)))
+				};
+				if (wedge.min_y <= wedge.max_y)
+					wedges.push_back(wedge);
+			}
+		}
+	}
+
+	// Bucketing wedges into bands
+	std::vector<std::size_t> band_offsets(bands_cnt+1, 0);
+	for (const wedge_t &wedge : wedges)
+		for (int b = wedge.min_y / BAND_HEIGHT;
+				b <= wedge.max_y / BAND_HEIGHT; ++b)
+			++band_offsets[b+1];
+	for (int b = 0; b < bands_cnt; ++b)
+		band_offsets[b+1] += band_offsets[b];
+	std::vector<std::size_t> band_wedges(band_offsets[bands_cnt]);
+	{
+		std::vector<std::size_t> band_fill(
+				band_offsets.begin(), band_offsets.end()-1);
+		for (std::size_t w = 0; w < wedges.size(); ++w)
+			for (int b = wedges[w].min_y / BAND_HEIGHT;
+					b <= wedges[w].max_y / BAND_HEIGHT; ++b)
+				band_wedges[band_fill[b]++] = w;
+	}
+
+	std::vector<uint8_t> covered(
+			static_cast<std::size_t>(third_width) * height, 0);
+	// Samples of the finest preview level are the same as the ones
+	// computed here, so they are kept
+	if (map_drawn_progressively)
+		for (int y = 0; y < height; y += 2)
+			for (int x = 0; x < third_width; x += 2)
+				covered[static_cast<std::size_t>(y)*third_width + x] = 1;
+
+	// Restricts [x_lo, x_hi] to x satisfying sign*det(u, (x, y) - q) <= 0
+	auto clip_span = [] (
+			const dvec2 u, const dvec2 q, const double sign, const double y,
+			double &x_lo, double &x_hi) {
+		const double a = sign * (u.x * (y - q.y) + u.y * q.x);
+		const double b = sign * -u.y;
+		if (b == 0) {
+			if (a > 0)
+				x_hi = x_lo - 1;
+		} else if (b > 0) {
+			min_replace(x_hi, -a / b);
+		} else {
+			max_replace(x_lo, -a / b);
+		}
+	};
+
+	#pragma omp parallel for schedule (dynamic, 1)
+	for (int b = 0; b < bands_cnt; ++b) {
+		const int band_beg_y = b * BAND_HEIGHT;
+		const int band_end_y = std::min(height, band_beg_y + BAND_HEIGHT);
+
+		for (std::size_t k = band_offsets[b]; k < band_offsets[b+1]; ++k) {
+			const wedge_t &wedge = wedges[band_wedges[k]];
+			const voronoi_t &voro = diagram.voronois[wedge.voro_id.id];
+			const voronoi_t::edge_t &edge = voro.al[wedge.edge_id];
+			const dvec2 off
+				= (
+					wedge.voro_id.type == voro_id_t::LEFT ?
+					-diagram.duplicate_off_vec :
+					wedge.voro_id.type == voro_id_t::RIGHT ?
+					diagram.duplicate_off_vec :
+					dvec2(0)
+				);
+			const dvec2 center = voro.center + off;
+			// beg <- p <- end
+			const dvec2 A = (edge.beg + off) - center;
+			const dvec2 C = (edge.end + off) - center;
+			const dvec2 edge_dir = edge.end - edge.beg;
+			const double edge_side
+				= determinant(edge_dir, center - (edge.beg + off));
+			if (edge_side == 0)
+				continue;
+			const double edge_sign = edge_side > 0 ? -1.0 : 1.0;
+
+			// Same cases as in get_elevation_A_in_wedge. Between plates of
+			// different types, the elevation falls linearly from the edge
+			// to the center, t = n*(p - center) / n*(beg - center).
+			// Otherwise it falls from the center's ridge towards the wedge's
+			// sides, with the signed distance det(to_mid, p - center).
+			const plate_t::type_t plate_type = plates[wedge.voro_id.id].type;
+			const bool border_wedge
+				= plate_type != plates[edge.neighbor_id].type;
+			const auto [prev_type, nxt_type]
+				= get_adjacent_edges_types(voro, wedge.edge_id);
+			const bool ridge_wedge = not border_wedge
+				and (prev_type != plate_t::NONE or nxt_type != plate_t::NONE);
+			const bool prev_coast
+				= prev_type != plate_t::NONE and plate_type != prev_type;
+			const bool nxt_coast
+				= nxt_type != plate_t::NONE and plate_type != nxt_type;
+			const dvec2 edge_normal(-edge_dir.y, edge_dir.x);
+			const double border_mult = 1.0 / glm::dot(edge_normal, A);
+			const double ridge_mult
+				= 2.0 / edge.to_mid_len / edge.voro_edge_len;
+			const double term_step = x_space_to_map_inv * (
+				border_wedge ? edge_normal.x * border_mult :
+				ridge_wedge ? -edge.to_mid.y :
+				0.0);
+
+			const int y_beg = std::max(band_beg_y, wedge.min_y);
+			const int y_end = std::min(band_end_y, wedge.max_y+1);
+			for (int y = y_beg; y < y_end; ++y) {
+				const double p_y = map_to_space_coords(dvec2(0, y)).y;
+				double x_lo = -std::numeric_limits<double>::max();
+				double x_hi = std::numeric_limits<double>::max();
+				clip_span(C, center, 1.0, p_y, x_lo, x_hi);
+				clip_span(A, center, -1.0, p_y, x_lo, x_hi);
+				clip_span(edge_dir, edge.beg + off, edge_sign, p_y,
+						x_lo, x_hi);
+				if (x_lo > x_hi)
+					continue;
+
+				// Span is widened by a pixel, exact tests are done below
+				const int x_map_beg = std::max<double>(
+						third_width,
+						std::floor(x_lo * x_space_to_map) - 1);
+				const int x_map_end = std::min<double>(
+						2*third_width - 1,
+						std::ceil(x_hi * x_space_to_map) + 1);
+				double term;
+				{
+					const dvec2 B
+						= map_to_space_coords(dvec2(x_map_beg, y)) - center;
+					term = border_wedge ? glm::dot(edge_normal, B)*border_mult
+						: ridge_wedge ? determinant(edge.to_mid, B)
+						: 0.0;
+				}
+				for (int x_map = x_map_beg; x_map <= x_map_end;
+						++x_map, term += term_step) {
+					const int x = x_map - third_width;
+					uint8_t &pixel_covered
+						= covered[static_cast<std::size_t>(y)*third_width + x];
+					if (pixel_covered)
+						continue;
+
+					const dvec2 p = map_to_space_coords(dvec2(x_map, y));
+					const dvec2 B = p - center;
+					if (determinant(C, B) >= -BORDER_EPS
+							or determinant(B, A) >= -BORDER_EPS)
+						continue;
+					if (edge_sign * determinant(
+								edge_dir, p - (edge.beg + off))
+							>= -BORDER_EPS)
+						continue;
+
+					plate_t::type_t pixel_type = plate_type;
+					double elevation = 0.0;
+					if (border_wedge) {
+						elevation = 1.0 - term;
+						if (elevation <= 1.0)
+							pixel_type = plate_t::COAST;
+					} else if (ridge_wedge) {
+						elevation = 1.0 - std::abs(term) * ridge_mult;
+						if ((prev_coast and term <= 0)
+								or (nxt_coast and term >= 0))
+							pixel_type = plate_t::COAST;
+					}
+					scale_wedge_elevation_A(plate_type, pixel_type, elevation);
+
+					pixel_covered = 1;
+					draw_elevation_A_pixel(y, x,
+						get_noised_elevation_A(p, pixel_type, elevation));
+				}
+			}
+		}
+
+		for (int y = band_beg_y; y < band_end_y; ++y) {
+			for (int x = 0; x < third_width; ++x) {
+				if (covered[static_cast<std::size_t>(y)*third_width + x])
+					continue;
+				const dvec2 p = map_to_space_coords(dvec2(x+third_width, y));
+				draw_elevation_A_pixel(y, x, get_elevation_A(p));
+			}
+		}
+	}
+}
+
+void map_generator_t::draw_map_level(
+		const int step, const bool coarser_level_drawn) {
+	const int rows_cnt = ceil_div(height, step);
+
+#pragma omp parallel for schedule (dynamic, 1)
+	for (int row = 0; row < rows_cnt; ++row) {
+		const int y = row*step;
+		const int block_end_y = std::min(y+step, height);
+		for (int x = 0; x < third_width; x += step) {
+			if (coarser_level_drawn and y % (2*step) == 0 and x % (2*step) == 0)
+				continue;
+
+			const dvec2 p = map_to_space_coords(dvec2(x+third_width, y));
+			const auto [color, elevation_A_byte, elevation]
+				= get_elevation_A_pixel(get_elevation_A(p));
+			const int block_end_x = std::min(x+step, third_width);
+			for (int block_y = y; block_y < block_end_y; ++block_y) {
+				for (int block_x = x; block_x < block_end_x; ++block_x) {
+					for (int copy = 0; copy < stored_copies_cnt; ++copy) {
+						const int storage_x
+							= block_x + width*copy/stored_copies_cnt;
+						map_storage->set_rgb_value(block_y, storage_x, color);
+						map_storage->get_component_reference(
+								block_y, storage_x, 3) = elevation_A_byte;
+						map_storage->get_elevation_reference(
+								block_y, storage_x) = elevation;
+					}
+				}
+			}
+		}
+	}
+}
+
+void map_generator_t::draw_map_progressively() {
+	map_storage->clear();
+	// The full resolution level is rasterized by draw_map_cpu
+	for (int step = PREVIEW_STEP; step >= 2; step /= 2) {
+		draw_map_level(step, step != PREVIEW_STEP);
+		map_level_callback(step);
+	}
+	map_drawn_progressively = true;
+}
+
 void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 // #define DRAW_GRID
 #ifdef DRAW_GRID
@@ -918,45 +1500,7 @@ void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 #ifdef PSEUDO_PARALLEL_FILL
 	std::chrono::high_resolution_clock clock;
 	const auto timer_start = clock.now();
-	#pragma omp parallel for schedule (dynamic, 8)
-	for (int y = 0; y < height; ++y) {
-		for (std::size_t x = 0; x < static_cast<std::size_t>(width) / 3; ++x) {
-			const dvec2 p = map_to_space_coords(dvec2(x+width/3, y));
-
-			double elevation_A = get_elevation_A(p);
-			assert(in_between_inclusive(0.0, 1.0, elevation_A));
-
-			uint32_t color;
-			if (elevation_A < 0.5)
-				elevation_A = 0.15 + 0.25 * elevation_A;
-			else
-				elevation_A = 0.0 + 1.0 * elevation_A;
-
-			// color = lerp(0, 0xff, elevation_A);
-			// color = color | (color << 8) | (color << 16);
-
-			color = hsv_to_rgb(
-				(1.0 - elevation_A) * 240.0 / 360.0, 0.6, 0.8);
-
-			// if (debug_vals[1] % 2 == 1) {
-			// 	// PRINT_F(noise_val);
-			// 	color = lerp(0xff, 0, noise_val);
-			// 	color = color | (color << 8) | (color << 16);
-			// }
-
-			map_storage->set_rgb_value(y, x+width*0/3, color);
-			map_storage->set_rgb_value(y, x+width*1/3, color);
-			map_storage->set_rgb_value(y, x+width*2/3, color);
-
-			const uint8_t elevation_A_byte = elevation_A * 255.0;
-			map_storage->get_component_reference(y, x+width*0/3, 3)
-				= elevation_A_byte;
-			map_storage->get_component_reference(y, x+width*1/3, 3)
-				= elevation_A_byte;
-			map_storage->get_component_reference(y, x+width*2/3, 3)
-				= elevation_A_byte;
-		}
-	}
+	rasterize_voronoi_wedges();
 	const auto diff = clock.now() - timer_start;
 	const auto render_time_ms
 		= std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
@@ -987,6 +1531,8 @@ void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 					voronoi.points[j+1 == voronoi.points.size() ? 0 : j+1],
 					// color, true);
 					override_color, false);
+			if (map_single_copy)
+				continue;
 
 			draw_edge(
 					voronoi.points[j]
@@ -1074,7 +1620,7 @@ void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 #undef DRAW_NOISY
 	};
 
-	if (global_settings.draw_mid_polygons)
+	if (settings.draw_mid_polygons)
 		for (std::size_t i = 0; i < diagram.voronois_cnt(); ++i) {
 			draw_voronoi(i);
 		}
@@ -1095,17 +1641,17 @@ void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 
 // #define FLOOD_FILL
 #ifdef FLOOD_FILL
+	std::vector<std::pair<dvec2, uint32_t>> fill_seeds;
 	for (std::size_t i = 0; i < diagram.voronois_cnt(); ++i) {
 		const voronoi_t &voronoi = diagram.voronois[i];
-		fill(voronoi.center, COLORS[
-				static_cast<uint8_t>(plates[i].type)]);
-
-		fill(voronoi.center + diagram.duplicate_off_vec, COLORS[
-				static_cast<uint8_t>(plates[i].type)]);
-
-		fill(voronoi.center - diagram.duplicate_off_vec, COLORS[
-				static_cast<uint8_t>(plates[i].type)]);
+		const uint32_t color = COLORS[static_cast<uint8_t>(plates[i].type)];
+		fill_seeds.push_back({voronoi.center, color});
+		fill_seeds.push_back(
+				{voronoi.center + diagram.duplicate_off_vec, color});
+		fill_seeds.push_back(
+				{voronoi.center - diagram.duplicate_off_vec, color});
 	}
+	fill(fill_seeds);
 #endif
 #undef FLOOD_FILL
 
@@ -1123,41 +1669,291 @@ void map_generator_t::draw_map_cpu([[maybe_unused]] std::mt19937 &gen) {
 #undef DRAW_SPACE_CYCLIC_BORDER
 }
 
-void map_generator_t::generate_map() {
-    PRINT_NL;
+void map_generator_t::generate_map_for_tiles() {
+	assert(not settings.generate_with_gpu);
+	generation_graph.invalidate_all();
+	current_map_key = 0;
 	std::mt19937 gen(seed_voronoi);
 	PRINT_LU(seed_voronoi);
-    // printf("seed_voronoi = %lu\n", seed_voronoi);
 	generate_continents(gen);
+	generate_grid_intersections();
+}
 
-	if (not global_settings.generate_with_gpu) {
-		map_storage->clear();
-		generate_grid_intersections();
-		// std::size_t avg_cnt = 0;
-		// std::size_t max_cnt = 0;
-		// for (size_t y = 0; y < grid_height; ++y) {
-		// 	for (size_t x = 0; x < grid_width; ++x) {
-		// 		avg_cnt += grid[y][x].size();
-		// 		max_replace(max_cnt, grid[y][x].size());
-		// 	}
-		// }
-		// avg_cnt /= grid_height*grid_width;
-		// PRINT_ZU(avg_cnt);
-		// PRINT_ZU(max_cnt);
-		// // for (const auto e : grid[1][0])
-		// // 	PRINT_ZU(e);
-		draw_map_cpu(gen);
-		if (global_settings.generate_rivers) {
-			generate_joints(gen);
-			generate_rivers(gen);
-			if (global_settings.draw_temperature or
-					global_settings.draw_humidity)
-				calculate_climate();
+void map_generator_t::generate_map_tile(int tile_y, int tile_x,
+		int tile_dim, int tiles_width, uint8_t *content) const {
+	const int beg_y = tile_y * tile_dim;
+	const int beg_x = tile_x * tile_dim;
+	// Tiles span the middle copy of the map tripled from their own width,
+	// independently of the storage's layout
+	const double x_mult = 3.0*space_max.x / double(3*tiles_width - 1);
+	const double y_mult = space_max.y / double(height - 1);
+	#pragma omp parallel for schedule (dynamic, 8)
+	for (int y = 0; y < tile_dim; ++y) {
+		for (int x = 0; x < tile_dim; ++x) {
+			uint8_t * const pixel = content + (y*tile_dim + x)*4;
+			if (beg_y+y >= height or beg_x+x >= tiles_width) {
+				pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+				continue;
+			}
+			const dvec2 p(
+				double(beg_x+x + tiles_width) * x_mult,
+				double(beg_y+y) * y_mult);
+			const auto [color, elevation_A_byte, elevation]
+				= get_elevation_A_pixel(get_elevation_A(p));
+			pixel[0] = (color & 0xff0000) >> 16;
+			pixel[1] = (color & 0x00ff00) >> 8;
+			pixel[2] = (color & 0x0000ff) >> 0;
+			pixel[3] = elevation_A_byte;
 		}
-		if (global_settings.draw_player)
-			draw_tour_path(gen);
+	}
+}
+
+void map_generator_t::build_generation_graph() {
+	const std::size_t continents = generation_graph.add_task(
+		"continents", {},
+		[this] () {
+			std::mt19937 gen(seed_voronoi);
+			generate_continents(gen);
+			gen_after_continents = gen;
+		},
+		[this] () {
+			return task_graph_t::hash_inputs(seed_voronoi,
+				voro_cnt, super_voro_cnt, settings.land_probability,
+				width, height, space_max.x, grid_box_dim_zu, cyclic_map);
+		},
+		true);
+
+	const std::size_t grid = grid_task = generation_graph.add_task(
+		"grid_intersections", {continents},
+		[this] () {
+			generate_grid_intersections();
+		},
+		nullptr, true);
+
+	const std::size_t map = draw_map_task = generation_graph.add_task(
+		"draw_map", {grid},
+		[this] () {
+			if (not map_drawn_progressively)
+				map_storage->clear();
+			std::mt19937 gen = gen_after_continents;
+			// The map is drawn anew, there are no overlays to undo
+			logging_overlays = false;
+			overlays_log.clear();
+			overlays_mask.assign(std::size_t(width)*height, false);
+			draw_map_cpu(gen);
+			map_drawn_progressively = false;
+		},
+		[this] () {
+			return task_graph_t::hash_inputs(
+				settings.draw_mid_polygons);
+		},
+		true);
+
+	// Joints do not depend on the map, so they are sampled on a single
+	// thread while the map is being drawn with the other ones
+	const std::size_t joints = generation_graph.add_task(
+		"joints", {continents},
+		[this] () {
+			std::mt19937 gen = gen_after_continents;
+			if (settings.generate_rivers)
+				generate_joints(gen);
+			gen_after_joints = gen;
+		},
+		[this] () {
+			return task_graph_t::hash_inputs(
+				settings.generate_rivers,
+				settings.river_joints_R);
+		});
+
+	const std::size_t joints_elevation = generation_graph.add_task(
+		"joints_elevation", {joints, grid},
+		[this] () {
+			if (settings.generate_rivers)
+				calculate_joints_elevation();
+		});
+
+	// Overlays are drawn on top of each other, so all of them are redrawn
+	// onto a fresh copy of the map when any of their inputs changes,
+	// including the joints
+	const std::size_t overlays_base = generation_graph.add_task(
+		"restore_base_map", {map, joints_elevation},
+		[this] () {
+			for (const overlay_pixel_t &pixel : overlays_log) {
+				map_storage->set_rgb_value(pixel.id / width,
+					pixel.id % width, pixel.prev_color);
+				overlays_mask[pixel.id] = false;
+			}
+			overlays_log.clear();
+			logging_overlays = true;
+		},
+		[this] () {
+			return task_graph_t::hash_inputs(
+				settings.generate_rivers,
+				settings.river_start_prob,
+				settings.river_branch_prob,
+				settings.river_color,
+				settings.draw_temperature,
+				settings.draw_humidity,
+				settings.humidity_scale,
+				settings.temperature_exp,
+				settings.draw_player);
+		});
+
+	const std::size_t rivers = generation_graph.add_task(
+		"rivers", {overlays_base},
+		[this] () {
+			std::mt19937 gen = gen_after_joints;
+			if (settings.generate_rivers)
+				generate_rivers(gen);
+			gen_after_rivers = gen;
+		});
+
+	const std::size_t climate = generation_graph.add_task(
+		"climate", {rivers},
+		[this] () {
+			// The climate planes are filled even if the climate is not drawn
+			if (settings.generate_rivers)
+				calculate_climate();
+			else
+				map_storage->clear_climate_planes();
+		});
+
+	generation_graph.add_task(
+		"tour_path", {climate},
+		[this] () {
+			std::mt19937 gen = gen_after_rivers;
+			if (settings.draw_player)
+				draw_tour_path(gen);
+		});
+}
+
+std::size_t map_generator_t::calculate_map_key() const {
+	return task_graph_t::hash_inputs(
+		GENERATOR_VERSION,
+		seed_voronoi,
+		voro_cnt,
+		super_voro_cnt,
+		settings.land_probability,
+		width,
+		height,
+		space_max.x,
+		grid_box_dim_zu,
+		cyclic_map,
+		settings.draw_mid_polygons,
+		settings.generate_rivers,
+		settings.river_joints_R,
+		settings.river_start_prob,
+		settings.river_branch_prob,
+		settings.river_color,
+		settings.draw_temperature,
+		settings.draw_humidity,
+		settings.humidity_scale,
+		settings.temperature_exp,
+		settings.draw_player);
+}
+
+void map_generator_t::set_map_level_callback(map_level_callback_t callback) {
+	map_level_callback = std::move(callback);
+}
+
+void map_generator_t::generate_map() {
+    PRINT_NL;
+	PRINT_LU(seed_voronoi);
+    // printf("seed_voronoi = %lu\n", seed_voronoi);
+
+	if (not settings.generate_with_gpu
+			or settings.emulate_gpu_on_cpu) {
+		generate_map_in_cpu_memory();
 		map_storage->load_from_cpu_to_gpu_memory();
+		return;
+	}
+
+	// Continents and the map below are not produced by the graph
+	generation_graph.invalidate_all();
+	current_map_key = 0;
+	clear_stages_outputs();
+	std::mt19937 gen(seed_voronoi);
+	generate_continents(gen);
+	// The GPU generator does not calculate the climate
+	map_storage->clear_climate_planes();
+	draw_map_gpu();
+}
+
+bool map_generator_t::generate_map_in_cpu_memory(
+		const std::atomic<bool> *cancel) {
+	const auto is_cancelled = [cancel] () {
+		return cancel != nullptr and cancel->load();
+	};
+
+	if (settings.generate_with_gpu) {
+		generation_graph.invalidate_all();
+		current_map_key = 0;
+		clear_stages_outputs();
+		std::mt19937 gen(seed_voronoi);
+		generate_continents(gen);
+		if (is_cancelled())
+			return false;
+		map_storage->clear_climate_planes();
+		draw_map_gpu_on_cpu();
+		return true;
+	}
+
+	// Only maps generated from a fixed seed can be found again
+	const bool use_map_cache = settings.use_map_cache
+		and settings.replace_seed != 0;
+	const std::size_t map_key = calculate_map_key();
+	map_cache.load_settings(settings);
+	if (map_key == current_map_key) {
+		// The map is up to date
+	} else if (use_map_cache and map_cache.load(map_key, *map_storage)) {
+		// Other outputs of the stages do not match the loaded map
+		generation_graph.invalidate_all();
+		clear_stages_outputs();
+		printf("Map loaded from the cache\n");
 	} else {
-		draw_map_gpu();
+		generation_graph.set_cancel_flag(cancel);
+		// Preview samples of a cancelled generation are not reused
+		map_drawn_progressively = false;
+		if (settings.progressive_map_generation
+				and map_level_callback
+				and generation_graph.is_outdated(draw_map_task)) {
+			generation_graph.run_up_to(grid_task);
+			if (generation_graph.was_last_run_cancelled()) {
+				generation_graph.set_cancel_flag(nullptr);
+				return false;
+			}
+			draw_map_progressively();
+		}
+		// Reruns only the stages whose inputs changed since the last call
+		generation_graph.run();
+		generation_graph.set_cancel_flag(nullptr);
+		if (generation_graph.was_last_run_cancelled())
+			return false;
+		DEBUGONLY(generation_graph.print_last_run_durations());
+		if (use_map_cache)
+			map_cache.store(map_key, *map_storage);
 	}
+	current_map_key = map_key;
+	return true;
+}
+
+void map_generator_t::invalidate_map() {
+	generation_graph.invalidate_all();
+	current_map_key = 0;
+}
+
+void map_generator_t::clear_stages_outputs() {
+	diagram.voronois.clear();
+	plates.clear();
+	grid_offsets.clear();
+	grid_ids.clear();
+	joints.clear();
+	joints_elevation.clear();
+	al_offsets.clear();
+	al_edges.clear();
+	joints_humidity.clear();
+	tour_path_points.clear();
+	overlays_log.clear();
+	overlays_mask.clear();
+	map_drawn_progressively = false;
 }
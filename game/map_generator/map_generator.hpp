@@ -6,32 +6,80 @@
 #define MAP_GENERATOR_HPP
 
 #include "map_storage.hpp"
+#include "map_cache.hpp"
 #include "noise.hpp"
 #include "voronoi.hpp"
+#include <task_graph.hpp>
 
 #include <random>
 #include <functional>
-
-// Catmull–Rom spline
-double spline(double t, const std::function<double(const long long)> &f);
-double spline_gradient(
-		double t, const std::function<double(const long long)> &f);
+#include <span>
+#include <atomic>
+
+// Catmull–Rom spline, f(i) returns the i-th control point, which may be
+// a number or a vector. Accessors are inlined, as splines are sampled densely.
+struct spline_weights_t {
+	// Weights of control points p1-1, p1, p1+1 and p1+2
+	long long p1;
+	double q[4];
+
+	template<class F>
+	inline auto apply(const F &f) const;
+};
+inline spline_weights_t get_spline_weights(double t);
+inline spline_weights_t get_spline_gradient_weights(double t);
+template<class F>
+inline auto spline(double t, const F &f);
+template<class F>
+inline auto spline_gradient(double t, const F &f);
 
 struct map_generator_t {
+	// Called with the level's step, once the level is drawn in the CPU
+	// memory. It is called by the generating thread, loading the level
+	// to the GPU is up to the callback.
+	typedef std::function<void(int step)> map_level_callback_t;
+
 	// Basic usage functions
-	map_generator_t(map_storage_t * const map_storage);
+	// Settings are read through the reference, by default to
+	// global_settings
+	map_generator_t(map_storage_t * const map_storage,
+			const settings_t &settings = global_settings);
 	void load_settings();
 	void init_gl();
 	void new_seed();
 	void generate_map();
+	// Same as above, but the map is left in the CPU memory and no OpenGL
+	// call is made, so it may run on another thread. The GPU generator is
+	// emulated. Setting `cancel` stops the generation between its stages,
+	// returns whether the map has been finished.
+	bool generate_map_in_cpu_memory(const std::atomic<bool> *cancel = nullptr);
+	// The next generation starts from scratch, needed once the storage's
+	// content has been replaced
+	void invalidate_map();
+	// With progressive_map_generation, the CPU generator first draws
+	// coarse levels of the map, so that they can be shown in the meantime
+	void set_map_level_callback(map_level_callback_t callback);
+	// Generates only what generate_map_tile needs, CPU generator only
+	void generate_map_for_tiles();
+	// Fills tile_dim*tile_dim*4 bytes of `content` with a tile
+	// of the not tripled map, tiles_width pixels wide. The layout is
+	// the same as in map_storage_t.
+	void generate_map_tile(int tile_y, int tile_x,
+			int tile_dim, int tiles_width, uint8_t *content) const;
 	void deinit_gl();
 
 	// State query functions
 	inline glm::dvec2 get_space_max() const;
 	inline double get_ratio_wh() const;
 	inline double get_ratio_hw() const;
+	inline bool is_map_single_copy() const;
 	inline bool are_tour_path_points_generated() const;
-	std::pair<glm::dvec2, glm::dvec2> get_tour_path_points(const double off);
+	std::pair<glm::dvec2, glm::dvec2> get_tour_path_points(
+			const double off) const;
+	// Same as above for many offsets at once, control points are fetched
+	// once per segment, so sorted offsets are the fastest
+	void get_tour_path_points(std::span<const double> offs,
+			std::span<std::pair<glm::dvec2, glm::dvec2>> points) const;
     inline std::mt19937::result_type get_current_voronoi_seed() const;
 
 	std::size_t * const debug_vals = global_settings.debug_vals;
@@ -53,6 +101,11 @@ private:
 		0x77c4dd, // WATER
 		0xfcf04b, // COAST
 	};
+	// Filled span of a row, whose neighboring rows are yet to be scanned
+	struct fill_span_t {
+		int y;
+		int beg_x, end_x;
+	};
 	struct joint_edge_t {
 		std::size_t dest;
 		enum type_t : uint8_t {
@@ -65,17 +118,38 @@ private:
 
 	// Private functions
 	void calculate_constants();
+	// Builds stages of the CPU generator, generate_map runs them
+	void build_generation_graph();
+	// Hash of the seed and all settings affecting the CPU generated map
+	std::size_t calculate_map_key() const;
+	// Value of the t uniform, milliseconds since the first call
+	float get_shader_time();
 	void set_uniforms();
 
 	inline glm::dvec2 space_to_map_coords(glm::dvec2 pos) const;
 	inline glm::dvec2 map_to_space_coords(glm::dvec2 pos) const;
+	// Converts x of a pixel of the tripled map to the storage, returns false
+	// if the pixel is not stored
+	inline bool map_to_storage_x(double map_x, int &x) const;
+	// Sets the pixel's color, its previous color is logged while
+	// the overlays are drawn
+	inline void draw_pixel(int y, int x, uint32_t color);
 	void draw_edge(glm::dvec2 beg, glm::dvec2 end,
 			uint32_t color, bool draw_only_empty = false);
 	void draw_point(glm::dvec2 pos, double dim,
 			uint32_t color);
+	// Calls f(y, x) for pixels of the square drawn by draw_point, x is
+	// given in the tripled map coordinates
+	template<class F>
+	void for_each_point_pixel(glm::dvec2 pos, double dim, const F &f) const;
 	// Fills whole consistent black space starting at origin
 	void fill(glm::dvec2 origin,
 			uint32_t fill_color);
+	// Same as above for many seeds at once, filled in parallel.
+	// Seeds have to lie in pairwise disjoint black spaces.
+	void fill(const std::vector<std::pair<glm::dvec2, uint32_t>> &seeds);
+	void fill_region(glm::ivec2 first_pixel, uint32_t fill_color,
+			std::vector<fill_span_t> &spans);
 	void draw_convex_polygon(
 			const std::vector<glm::dvec2> _points,
 			const uint32_t color);
@@ -89,24 +163,80 @@ private:
 			const glm::dvec2 Y,
 			const uint32_t color);
 
+	// Drops outputs of the stages, once the map in the storage has not
+	// been generated by them
+	void clear_stages_outputs();
 	void generate_continents(std::mt19937 &gen);
 	void generate_grid_intersections();
 	void generate_joints(std::mt19937 &gen);
+	void calculate_joints_elevation();
 	void generate_rivers(std::mt19937 &gen);
 	void calculate_climate();
+	// Sets pixels of the climate planes to the values of the nearest joint
+	void fill_climate_planes(const std::vector<uint8_t> &humidity_values,
+			const std::vector<uint8_t> &temperature_values);
 	void draw_map_cpu(std::mt19937 &gen);
+	// Scanline rasterizes triangle fans of voronoi polygons into the middle
+	// third of the map, linear terms of the elevation are stepped along
+	// rows. Pixels left uncovered or lying on wedges' borders fall back to
+	// get_elevation_A.
+	void rasterize_voronoi_wedges();
+	// Draws elevation of pixels lying on the grid of the given step,
+	// each one as a step*step block. Pixels on the grid of the twice larger
+	// step are reused, if that level is drawn already.
+	void draw_map_level(int step, bool coarser_level_drawn);
+	// Draws levels from PREVIEW_STEP down to step 2 and passes them
+	// to the map level callback. Samples of the step 2 level are kept
+	// by draw_map_cpu, the other ones are drawn over.
+	void draw_map_progressively();
+	void draw_elevation_A_pixel(int y, int x, double elevation_A);
+	struct elevation_A_pixel_t {
+		uint32_t color;
+		// Alpha channel byte
+		uint8_t elevation_byte;
+		// Value of the elevation plane
+		uint16_t elevation;
+	};
+	elevation_A_pixel_t get_elevation_A_pixel(double elevation_A) const;
+	// Fills continents_triangles_pos and continents_elevation
+	void build_continents_triangles();
 	void draw_map_gpu();
+	// Rasterizes the same triangles as draw_map_gpu into the CPU memory,
+	// without OpenGL. Pixels match the GPU up to its rounding.
+	void draw_map_gpu_on_cpu();
 	void draw_tour_path(std::mt19937 &gen);
 
 	double get_temperature(const glm::dvec2 &p) const;
+	double get_temperature(const glm::dvec2 &p, double elevation) const;
 	double get_elevation_A(const glm::dvec2 &p) const;
+	// Elevation of p lying inside the triangle spanned by the center of
+	// voro_id and its edge_id-th edge
+	double get_elevation_A_in_wedge(
+			const glm::dvec2 &p,
+			const voro_id_t voro_id,
+			const std::size_t edge_id) const;
+	// Types of plates behind the edges preceding and following edge_id,
+	// NONE if there is no such edge
+	std::pair<plate_t::type_t, plate_t::type_t> get_adjacent_edges_types(
+			const voronoi_t &voro, std::size_t edge_id) const;
+	// Remaining steps of get_elevation_A_in_wedge, after the elevation
+	// has been calculated from the wedge's geometry
+	void scale_wedge_elevation_A(plate_t::type_t plate_type,
+			plate_t::type_t &pixel_type, double &elevation) const;
+	double get_noised_elevation_A(const glm::dvec2 &p,
+			plate_t::type_t pixel_type, double elevation) const;
 
 	inline glm::tvec2<long long, glm::highp> space_to_grid_coords(
 		const glm::dvec2 &p) const;
+	// Control point of the tour path, ids outside of tour_path_points
+	// lie on copies of the path shifted by the space duplicate offset
+	inline glm::dvec2 get_tour_path_point(const long long id) const;
+	inline std::span<joint_edge_t> get_joint_edges(std::size_t v);
 
 	// Private data
 	// Map storage
 	map_storage_t * const map_storage;
+	const settings_t &settings;
 	// Constants
 	std::size_t grid_box_dim_zu;
 
@@ -114,6 +244,16 @@ private:
 	const int &width, &height;
 	// Ratios of the map storage coordinates
 	double ratio_wh, ratio_hw;
+	// Triangulations duplicate only points near the cyclic border
+	bool cyclic_map;
+	// The cyclic map without triple_map_size is stored as only the middle
+	// one third of the tripled map, the other ones wrap onto it. Otherwise
+	// the storage holds all three copies.
+	bool map_single_copy;
+	int stored_copies_cnt;
+	// Width of the tripled map and its one third
+	int map_width, third_width;
+	double map_ratio_wh;
 	glm::dvec2 space_max; // Maximum double coordinates of not tripled space
 	glm::dvec2 real_space_max; // Maximum double coordinates of tripled space
 	double space_max_x_duplicate_off;
@@ -124,27 +264,69 @@ private:
 
 	double grid_box_dim_f;
 	static constexpr int GREATEST_WATER_DIST = std::numeric_limits<int>::max();
+	// Width of the band of duplicated voronoi centers of the cyclic map,
+	// in mean distances between centers
+	static constexpr double CYCLIC_BAND_SPACINGS = 4.0;
 	double noise_pos_mult;
 
 	// Small variables
-	const std::function<double(const long long)> get_tour_path_point_x;
-	const std::function<double(const long long)> get_tour_path_point_y;
 	std::mt19937::result_type seed_voronoi;
 	cyclic_noise_t noise;
     long app_start_ms = -1;
+	// Span stack reused by fill
+	std::vector<fill_span_t> fill_spans;
+
+	// Stages of the CPU generator and their outputs, which are not stored
+	// anywhere else. Every stage takes generator's state left by
+	// the previous stage using it, so results match the sequential order.
+	task_graph_t generation_graph;
+	std::mt19937 gen_after_continents;
+	std::mt19937 gen_after_joints;
+	std::mt19937 gen_after_rivers;
+	// Colors drawn by draw_map_cpu under the pixels overwritten by
+	// the overlays (rivers, climate and the tour path), only the first
+	// overwrite of a pixel is logged
+	struct overlay_pixel_t {
+		uint32_t id;
+		uint32_t prev_color;
+	};
+	std::vector<overlay_pixel_t> overlays_log;
+	std::vector<bool> overlays_mask;
+	bool logging_overlays = false;
+	std::size_t grid_task;
+	std::size_t draw_map_task;
+
+	// Progressive generation
+	static constexpr int PREVIEW_STEP = 8;
+	map_level_callback_t map_level_callback;
+	// Pixels on the grid of step 2 are drawn, the rasterizer skips them
+	bool map_drawn_progressively = false;
+
+	// Has to be changed along with changes of the CPU generated maps,
+	// so that older maps are not loaded from the cache
+	static constexpr std::size_t GENERATOR_VERSION = 2;
+	map_cache_t map_cache;
+	// Key of the CPU generated map currently in the map storage
+	std::size_t current_map_key = 0;
 
 	// Voronoi diagram
 	std::size_t voro_cnt;
 	std::size_t super_voro_cnt;
-	// Contains intersections of grid boxes with voronoi polygons
-	std::vector<std::vector<std::vector<voro_id_t>>> grid;
+	// Contains intersections of grid boxes with voronoi polygons,
+	// box (y, x) holds grid_ids[grid_offsets[i]..grid_offsets[i+1]),
+	// where i = y*grid_width + x
+	std::vector<std::size_t> grid_offsets;
+	std::vector<voro_id_t> grid_ids;
 	voronoi_diagram_t diagram;
 	std::vector<plate_t> plates;
 
 	// Joints etc.
 	std::vector<glm::dvec2> tour_path_points;
 	std::vector<glm::dvec2> joints;
-	std::vector<std::vector<joint_edge_t>> al;
+	std::vector<double> joints_elevation;
+	// Edges of joint v are al_edges[al_offsets[v]..al_offsets[v+1])
+	std::vector<std::size_t> al_offsets;
+	std::vector<joint_edge_t> al_edges;
 	std::vector<int> joints_humidity;
 
 	// OpenGL names
@@ -165,6 +347,56 @@ private:
 	std::vector<float> continents_elevation;
 };
 
+template<class F>
+inline auto spline_weights_t::apply(const F &f) const {
+	return 0.5 * (
+			f(p1-1) * q[0] + f(p1) * q[1] + f(p1+1) * q[2] + f(p1+2) * q[3]
+		);
+}
+
+inline spline_weights_t get_spline_weights(double t) {
+	const double floor_t = std::floor(t);
+	t -= floor_t;
+	const double tt = t * t;
+	const double ttt = tt * t;
+
+	return {
+		static_cast<long long>(floor_t),
+		{
+			-ttt + 2.0f*tt - t,
+			3.0f*ttt - 5.0f*tt + 2.0f,
+			-3.0f*ttt + 4.0f*tt + t,
+			ttt - tt,
+		}
+	};
+}
+
+inline spline_weights_t get_spline_gradient_weights(double t) {
+	const double floor_t = std::floor(t);
+	t -= floor_t;
+	const double tt = t * t;
+
+	return {
+		static_cast<long long>(floor_t),
+		{
+			-3.0 * tt + 4.0*t - 1,
+			9.0*tt - 10.0*t,
+			-9.0*tt + 8.0*t + 1.0,
+			3.0*tt - 2.0*t,
+		}
+	};
+}
+
+template<class F>
+inline auto spline(double t, const F &f) {
+	return get_spline_weights(t).apply(f);
+}
+
+template<class F>
+inline auto spline_gradient(double t, const F &f) {
+	return get_spline_gradient_weights(t).apply(f);
+}
+
 inline glm::dvec2 map_generator_t::get_space_max() const {
 	return space_max;
 }
@@ -177,6 +409,17 @@ inline double map_generator_t::get_ratio_hw() const {
 	return ratio_hw;
 }
 
+inline bool map_generator_t::is_map_single_copy() const {
+	return map_single_copy;
+}
+
+inline std::span<map_generator_t::joint_edge_t>
+	map_generator_t::get_joint_edges(std::size_t v) {
+	return std::span<joint_edge_t>(
+			al_edges.begin() + al_offsets[v],
+			al_edges.begin() + al_offsets[v+1]);
+}
+
 inline bool map_generator_t::are_tour_path_points_generated() const {
 	return tour_path_points.size() > 0;
 }
@@ -185,21 +428,57 @@ inline std::mt19937::result_type map_generator_t::get_current_voronoi_seed() con
     return seed_voronoi;
 }
 
+inline void map_generator_t::draw_pixel(int y, int x, uint32_t color) {
+	const uint32_t id = uint32_t(y)*width + x;
+	if (logging_overlays and not overlays_mask[id]) {
+		overlays_mask[id] = true;
+		overlays_log.push_back({id, map_storage->get_rgb_value(y, x)});
+	}
+	map_storage->set_rgb_value(y, x, color);
+}
+
 inline glm::dvec2 map_generator_t::space_to_map_coords(glm::dvec2 pos) const {
 	return
-		pos.x = pos.x * double(width-1) / (3.0*space_max.x),
+		pos.x = pos.x * double(map_width-1) / (3.0*space_max.x),
 		pos.y = pos.y * double(height-1) / space_max.y,
 
 		pos;
 }
 inline glm::dvec2 map_generator_t::map_to_space_coords(glm::dvec2 pos) const {
 	return
-		pos.x = pos.x * (3.0*space_max.x) / double(width-1),
+		pos.x = pos.x * (3.0*space_max.x) / double(map_width-1),
 		pos.y = pos.y * space_max.y / double(height-1),
 
 		pos;
 }
 
+inline bool map_generator_t::map_to_storage_x(
+		const double map_x, int &x) const {
+	if (not map_single_copy) {
+		if (map_x < 0 || map_x >= double(width))
+			return false;
+		x = map_x;
+		return true;
+	}
+	x = static_cast<int>(std::floor(map_x)) % width;
+	if (x < 0)
+		x += width;
+	return true;
+}
+
+inline glm::dvec2 map_generator_t::get_tour_path_point(
+		const long long id) const {
+	const auto [plane_id, point_id]
+		= floor_div_rem(
+				id,
+				static_cast<long long>(tour_path_points.size()));
+	return glm::dvec2(
+			tour_path_points[point_id].x
+			+ static_cast<double>(plane_id)
+			* diagram.space_max_x_duplicate_off,
+			tour_path_points[point_id].y);
+}
+
 inline glm::tvec2<long long, glm::highp> map_generator_t::space_to_grid_coords(
 	const glm::dvec2 &p) const {
 	return glm::tvec2<long long, glm::highp>(
@@ -60,13 +60,17 @@ void map_generator_t::init_gl() {
 	glBindVertexArray(0);
 }
 
-void map_generator_t::set_uniforms() {
+float map_generator_t::get_shader_time() {
 	const auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
 			std::chrono::high_resolution_clock::now().time_since_epoch()
 			).count();
     if (app_start_ms == -1) app_start_ms = now_ms;
 	const auto elapsed_ms = now_ms - app_start_ms;
-	const float t = float(elapsed_ms);
+	return float(elapsed_ms);
+}
+
+void map_generator_t::set_uniforms() {
+	const float t = get_shader_time();
 #if PROG == 1
 	glUseProgram(program1);
 	glUniform1f(t_prog1_uniform, t);
@@ -74,7 +78,7 @@ void map_generator_t::set_uniforms() {
 	glUseProgram(program2);
 	glUniform1f(t_prog2_uniform, t);
 	glUniform1i(triple_map_size_uniform,
-			global_settings.triple_map_size);
+			settings.triple_map_size);
 	glUniform2f(space_max_uniform, space_max.x, space_max.y);
 #endif
 }
@@ -89,32 +93,7 @@ void map_generator_t::deinit_gl() {
 }
 
 
-void map_generator_t::draw_map_gpu() {
-#if PROG == 1
-	// Shader program
-	glUseProgram(program1);
-
-	// Uniforms and texture
-	glBindImageTexture(
-			0,
-			map_storage->get_texture_id(),
-			0,
-			GL_FALSE,
-			0,
-			GL_WRITE_ONLY,
-			GL_RGBA8
-			);
-
-	set_uniforms();
-
-	// Execute shader
-	glDispatchCompute(map_storage->get_width()/3, map_storage->get_height(), 1);
-
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-	// glFinish();
-
-#elif PROG == 2
-	// Prepare buffers
+void map_generator_t::build_continents_triangles() {
 	continents_triangles_pos.resize(0);
 	continents_elevation.resize(0);
 
@@ -199,6 +178,35 @@ void map_generator_t::draw_map_gpu() {
 			}
 		}
 	}
+}
+
+void map_generator_t::draw_map_gpu() {
+#if PROG == 1
+	// Shader program
+	glUseProgram(program1);
+
+	// Uniforms and texture
+	glBindImageTexture(
+			0,
+			map_storage->get_texture_id(),
+			0,
+			GL_FALSE,
+			0,
+			GL_WRITE_ONLY,
+			GL_RGBA8
+			);
+
+	set_uniforms();
+
+	// Execute shader
+	glDispatchCompute(map_storage->get_width()/3, map_storage->get_height(), 1);
+
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	// glFinish();
+
+#elif PROG == 2
+	// Prepare buffers
+	build_continents_triangles();
 
 	glBindBuffer(GL_ARRAY_BUFFER, continents_triangle_pos_buf);
 	glBufferData(GL_ARRAY_BUFFER,
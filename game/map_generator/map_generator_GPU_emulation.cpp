@@ -0,0 +1,399 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "map_generator.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include <useful.hpp>
+#include <settings.hpp>
+
+// CPU port of shader_map_generator_vertex.glsl and
+// shader_map_generator_fragment.glsl, calculations are done in floats as on
+// the GPU. Swizzles are written out, since glm is used without GLM_SWIZZLE.
+namespace {
+
+// BEGINNING of "webgl-noise" code port
+// Description : Array and textureless GLSL 2D/3D/4D simplex
+//               noise functions.
+//      Author : Ian McEwan, Ashima Arts.
+//  Maintainer : stegu
+//     Lastmod : 20201014 (stegu)
+//     License : Copyright (C) 2011 Ashima Arts. All rights reserved.
+//               Distributed under the MIT License. See LICENSE file.
+//               https://github.com/ashima/webgl-noise
+//               https://github.com/stegu/webgl-noise
+//
+inline vec3 mod289(vec3 x) {
+	return x - floor(x * (1.0f / 289.0f)) * 289.0f;
+}
+
+inline vec4 mod289(vec4 x) {
+	return x - floor(x * (1.0f / 289.0f)) * 289.0f;
+}
+
+inline vec4 permute(vec4 x) {
+	return mod289(((x*34.0f)+10.0f)*x);
+}
+
+inline vec4 taylor_inv_sqrt(vec4 r) {
+	return 1.79284291400159f - 0.85373472095314f * r;
+}
+
+float snoise(vec3 v) {
+	const vec2 C = vec2(1.0f/6.0f, 1.0f/3.0f);
+	const vec4 D = vec4(0.0f, 0.5f, 1.0f, 2.0f);
+
+	// First corner
+	vec3 i  = floor(v + dot(v, vec3(C.y)));
+	const vec3 x0 = v - i + dot(i, vec3(C.x));
+
+	// Other corners
+	const vec3 g = step(vec3(x0.y, x0.z, x0.x), x0);
+	const vec3 l = 1.0f - g;
+	const vec3 i1 = min(g, vec3(l.z, l.x, l.y));
+	const vec3 i2 = max(g, vec3(l.z, l.x, l.y));
+
+	const vec3 x1 = x0 - i1 + C.x;
+	const vec3 x2 = x0 - i2 + C.y; // 2.0*C.x = 1/3 = C.y
+	const vec3 x3 = x0 - D.y;      // -1.0+3.0*C.x = -0.5 = -D.y
+
+	// Permutations
+	i = mod289(i);
+	const vec4 p = permute( permute( permute(
+					i.z + vec4(0.0f, i1.z, i2.z, 1.0f ))
+				+ i.y + vec4(0.0f, i1.y, i2.y, 1.0f ))
+			+ i.x + vec4(0.0f, i1.x, i2.x, 1.0f ));
+
+	// Gradients: 7x7 points over a square, mapped onto an octahedron.
+	// The ring size 17*17 = 289 is close to a multiple of 49 (49*6 = 294)
+	const float n_ = 0.142857142857f; // 1.0/7.0
+	const vec3 ns = n_ * vec3(D.w, D.y, D.z) - vec3(D.x, D.z, D.x);
+
+	const vec4 j = p - 49.0f * floor(p * ns.z * ns.z);  //  mod(p,7*7)
+
+	const vec4 x_ = floor(j * ns.z);
+	const vec4 y_ = floor(j - 7.0f * x_ );    // mod(j,N)
+
+	const vec4 x = x_ *ns.x + ns.y;
+	const vec4 y = y_ *ns.x + ns.y;
+	const vec4 h = 1.0f - abs(x) - abs(y);
+
+	const vec4 b0 = vec4( x.x, x.y, y.x, y.y );
+	const vec4 b1 = vec4( x.z, x.w, y.z, y.w );
+
+	const vec4 s0 = floor(b0)*2.0f + 1.0f;
+	const vec4 s1 = floor(b1)*2.0f + 1.0f;
+	const vec4 sh = -step(h, vec4(0.0f));
+
+	const vec4 a0 = vec4(b0.x, b0.z, b0.y, b0.w)
+		+ vec4(s0.x, s0.z, s0.y, s0.w)*vec4(sh.x, sh.x, sh.y, sh.y);
+	const vec4 a1 = vec4(b1.x, b1.z, b1.y, b1.w)
+		+ vec4(s1.x, s1.z, s1.y, s1.w)*vec4(sh.z, sh.z, sh.w, sh.w);
+
+	vec3 p0 = vec3(a0.x, a0.y, h.x);
+	vec3 p1 = vec3(a0.z, a0.w, h.y);
+	vec3 p2 = vec3(a1.x, a1.y, h.z);
+	vec3 p3 = vec3(a1.z, a1.w, h.w);
+
+	//Normalise gradients
+	const vec4 norm = taylor_inv_sqrt(
+			vec4(dot(p0,p0), dot(p1,p1), dot(p2, p2), dot(p3,p3)));
+	p0 *= norm.x;
+	p1 *= norm.y;
+	p2 *= norm.z;
+	p3 *= norm.w;
+
+	// Mix final noise value
+	vec4 m = max(0.5f - vec4(dot(x0,x0), dot(x1,x1), dot(x2,x2), dot(x3,x3)),
+			0.0f);
+	m = m * m;
+	return 105.0f * dot( m*m, vec4( dot(p0,x0), dot(p1,x1),
+				dot(p2,x2), dot(p3,x3) ) );
+}
+// END of "webgl-noise" code port
+
+constexpr int OCTAVES = 6;
+float fbm(vec3 st) {
+	float value = 0.0f;
+	float amplitude = 0.5f;
+	for (int i = 0; i < OCTAVES; i++) {
+		value += amplitude * snoise(st);
+		st *= 2.0f;
+		amplitude *= 0.5f;
+	}
+	return value;
+}
+
+float fbm_warped(vec3 st) {
+	const float x = fbm(st + vec3(23.234f, 64.123f, 0.0f));
+	const float y = fbm(st + vec3(98.154f, 91.923f, 0.0f));
+	return fbm(st + vec3(x, y, 0.0f) * 0.7f);
+}
+
+vec3 hsv_to_rgb(vec3 c) {
+	const vec4 K = vec4(1.0f, 2.0f / 3.0f, 1.0f / 3.0f, 3.0f);
+	const vec3 p = abs(fract(vec3(c.x) + vec3(K.x, K.y, K.z)) * 6.0f
+			- vec3(K.w));
+	return c.z * mix(vec3(K.x), clamp(p - vec3(K.x), 0.0f, 1.0f), c.y);
+}
+
+float usual_noise(vec2 P, float t) {
+	return fbm_warped(vec3(P * 3.0f, t / 10000.0f)) + 0.5f;
+}
+
+float cyclic_noise_heuristic(vec2 P, vec2 space_max, float t) {
+	const float width = space_max.x;
+	P.x -= std::floor(P.x / width) * width;
+	const float margin = width * 0.1f;
+	const float n1 = usual_noise(P, t);
+	float n = n1;
+	if (P.x > width - margin) {
+		const float over_margin = P.x - (width - margin);
+		const float n2 = usual_noise(vec2(over_margin - margin, P.y), t);
+		n = mix(n1, n2, over_margin / margin);
+	}
+	return n;
+}
+
+// Fragment shader's main, returns the color written to the map
+vec4 shade_continents_fragment(
+		vec2 pos, float elevation, vec2 space_max, float t) {
+	{
+		const float x = elevation;
+		const float xx = x*x;
+		const float xxx = xx*x;
+		elevation = (-3.0f*xxx + 4.0f*xx + x) / 2.0f;
+	}
+
+	const vec2 P = pos - vec2(space_max.x, 0.0f);
+	const float noise_val = cyclic_noise_heuristic(P, space_max, t);
+
+	// pow of a negative value is undefined in GLSL, here it is 0
+	float noised_elevation
+		= -0.4f + elevation * 0.8f
+		+ std::pow(std::max(noise_val, 0.0f), 1.3f) * (0.6f + elevation * 0.0f);
+	noised_elevation = std::max(noised_elevation, 0.0f);
+
+	float hue = noised_elevation;
+	if (hue < 0.5f) hue = 0.15f + 0.25f * hue;
+	else hue = 0.0f + 1.0f * hue;
+
+	return vec4(hsv_to_rgb(vec3(
+		(1.0f - hue) * 240.0f / 360.0f, 0.6f, 0.8f)), noised_elevation);
+}
+
+// Conversion of a fragment shader output to GL_RGBA8
+inline uint8_t to_unorm8(float v) {
+	return static_cast<uint8_t>(std::lround(clamp(v, 0.0f, 1.0f) * 255.0f));
+}
+
+inline uint16_t to_unorm16(float v) {
+	return static_cast<uint16_t>(std::lround(
+			clamp(v, 0.0f, 1.0f) * float(map_storage_t::MAX_ELEVATION)));
+}
+
+}
+
+void map_generator_t::draw_map_gpu_on_cpu() {
+	build_continents_triangles();
+	const float t = get_shader_time();
+	const vec2 space_max_f = vec2(space_max);
+	const int triangles_cnt = continents_triangles_pos.size() / 3;
+
+	// Triangle in window coordinates, edge k is the one opposite to the
+	// vertex k and its edge function a[k]*x + b[k]*y + c[k] is positive
+	// inside the triangle and equals area at the vertex k
+	struct window_triangle_t {
+		double a[3], b[3], c[3];
+		// Whether pixels lying exactly on the edge belong to the triangle
+		bool owner[3];
+		double inv_area;
+		int beg_x, end_x, beg_y, end_y;
+		int first_vertex;
+	};
+
+	// Vertex shader, every triangle is drawn in 3 instances and the GPU
+	// draws them instance after instance, so later ones win in overlaps
+	std::vector<window_triangle_t> triangles;
+	triangles.reserve(3 * triangles_cnt);
+	for (int instance = 0; instance < 3; ++instance) {
+		for (int tri = 0; tri < triangles_cnt; ++tri) {
+			dvec2 v[3];
+			for (int k = 0; k < 3; ++k) {
+				vec2 P = continents_triangles_pos[3*tri + k];
+				P.x -= space_max_f.x;
+				P /= vec2(space_max_f.x*3.0f, space_max_f.y);
+				P.x += float(instance) * 1.0f / 3.0f;
+				P = 2.0f*P - 1.0f;
+				if (not settings.triple_map_size)
+					P.x *= 3.0f;
+				v[k] = dvec2(
+					(double(P.x) + 1.0) / 2.0 * width,
+					(double(P.y) + 1.0) / 2.0 * height);
+			}
+
+			window_triangle_t w;
+			for (int k = 0; k < 3; ++k) {
+				const dvec2 &A = v[(k+1) % 3];
+				const dvec2 &B = v[(k+2) % 3];
+				w.a[k] = -(B.y - A.y);
+				w.b[k] = B.x - A.x;
+				w.c[k] = -(w.a[k]*A.x + w.b[k]*A.y);
+			}
+			double area = w.a[0]*v[0].x + w.b[0]*v[0].y + w.c[0];
+			if (area == 0.0)
+				continue;
+			if (area < 0.0) {
+				area = -area;
+				for (int k = 0; k < 3; ++k) {
+					w.a[k] = -w.a[k];
+					w.b[k] = -w.b[k];
+					w.c[k] = -w.c[k];
+				}
+			}
+			// Edges shared by two triangles have opposite directions in
+			// them, so exactly one of them owns pixels lying on the edge
+			for (int k = 0; k < 3; ++k)
+				w.owner[k] = w.a[k] > 0.0 or (w.a[k] == 0.0 and w.b[k] < 0.0);
+			w.inv_area = 1.0 / area;
+
+			// Pixel centers lie at half integer coordinates
+			const double min_x = std::min({v[0].x, v[1].x, v[2].x});
+			const double max_x = std::max({v[0].x, v[1].x, v[2].x});
+			const double min_y = std::min({v[0].y, v[1].y, v[2].y});
+			const double max_y = std::max({v[0].y, v[1].y, v[2].y});
+			w.beg_x = std::max(0, int(std::floor(min_x - 0.5)));
+			w.end_x = std::min(width, int(std::ceil(max_x - 0.5)) + 1);
+			w.beg_y = std::max(0, int(std::floor(min_y - 0.5)));
+			w.end_y = std::min(height, int(std::ceil(max_y - 0.5)) + 1);
+			if (w.beg_x >= w.end_x or w.beg_y >= w.end_y)
+				continue;
+			w.first_vertex = 3*tri;
+			triangles.push_back(w);
+		}
+	}
+
+	// Bin triangles into tiles, tile i holds
+	// tile_triangles[tile_offsets[i]..tile_offsets[i+1]) in drawing order
+	constexpr int TILE_DIM = 32;
+	const int tiles_height = ceil_div(height, TILE_DIM);
+	const int tiles_width = ceil_div(width, TILE_DIM);
+	std::vector<std::size_t> tile_offsets(tiles_height*tiles_width + 1, 0);
+	for (const window_triangle_t &w : triangles)
+		for (int ty = w.beg_y / TILE_DIM; ty <= (w.end_y-1) / TILE_DIM; ++ty)
+			for (int tx = w.beg_x / TILE_DIM; tx <= (w.end_x-1) / TILE_DIM; ++tx)
+				++tile_offsets[ty*tiles_width + tx + 1];
+	for (int i = 0; i < tiles_height*tiles_width; ++i)
+		tile_offsets[i+1] += tile_offsets[i];
+	std::vector<std::size_t> tile_triangles(tile_offsets.back());
+	{
+		std::vector<std::size_t> tile_ends(
+				tile_offsets.begin(), tile_offsets.end()-1);
+		for (std::size_t i = 0; i < triangles.size(); ++i) {
+			const window_triangle_t &w = triangles[i];
+			for (int ty = w.beg_y / TILE_DIM; ty <= (w.end_y-1) / TILE_DIM; ++ty)
+				for (int tx = w.beg_x / TILE_DIM; tx <= (w.end_x-1) / TILE_DIM; ++tx)
+					tile_triangles[tile_ends[ty*tiles_width + tx]++] = i;
+		}
+	}
+
+	// Rasterize and shade tiles in parallel, the coverage of a tile's row is
+	// calculated at once with vectorized edge functions
+	#pragma omp parallel for schedule (dynamic, 4)
+	for (int tile = 0; tile < tiles_height*tiles_width; ++tile) {
+		const int tile_beg_y = tile / tiles_width * TILE_DIM;
+		const int tile_beg_x = tile % tiles_width * TILE_DIM;
+		const int tile_end_y = std::min(height, tile_beg_y + TILE_DIM);
+		const int tile_end_x = std::min(width, tile_beg_x + TILE_DIM);
+
+		// Clear color, blue
+		for (int y = tile_beg_y; y < tile_end_y; ++y) {
+			uint8_t *pixel = map_storage->get_row_pointer(y) + tile_beg_x*4;
+			for (int x = tile_beg_x; x < tile_end_x; ++x, pixel += 4) {
+				pixel[0] = 0;
+				pixel[1] = 0;
+				pixel[2] = to_unorm8(0.3f);
+				pixel[3] = 0;
+			}
+			uint16_t * const elevation_row
+				= map_storage->get_elevation_row_pointer(y);
+			std::fill(elevation_row + tile_beg_x, elevation_row + tile_end_x, 0);
+		}
+
+		double w0[TILE_DIM], w1[TILE_DIM], w2[TILE_DIM];
+		uint8_t covered[TILE_DIM];
+		for (std::size_t i = tile_offsets[tile]; i < tile_offsets[tile+1]; ++i) {
+			const window_triangle_t &w = triangles[tile_triangles[i]];
+			const int beg_x = std::max(w.beg_x, tile_beg_x);
+			const int end_x = std::min(w.end_x, tile_end_x);
+			const int beg_y = std::max(w.beg_y, tile_beg_y);
+			const int end_y = std::min(w.end_y, tile_end_y);
+			const int n = end_x - beg_x;
+			if (n <= 0 or beg_y >= end_y)
+				continue;
+
+			for (int y = beg_y; y < end_y; ++y) {
+				const double py = y + 0.5;
+				const double row0 = w.b[0]*py + w.c[0];
+				const double row1 = w.b[1]*py + w.c[1];
+				const double row2 = w.b[2]*py + w.c[2];
+				const bool owner0 = w.owner[0];
+				const bool owner1 = w.owner[1];
+				const bool owner2 = w.owner[2];
+				uint8_t any_covered = 0;
+				#pragma omp simd reduction(|:any_covered)
+				for (int j = 0; j < n; ++j) {
+					const double px = beg_x + j + 0.5;
+					const double e0 = w.a[0]*px + row0;
+					const double e1 = w.a[1]*px + row1;
+					const double e2 = w.a[2]*px + row2;
+					w0[j] = e0;
+					w1[j] = e1;
+					w2[j] = e2;
+					covered[j]
+						= ((e0 > 0.0) | ((e0 == 0.0) & owner0))
+						& ((e1 > 0.0) | ((e1 == 0.0) & owner1))
+						& ((e2 > 0.0) | ((e2 == 0.0) & owner2));
+					any_covered |= covered[j];
+				}
+				if (not any_covered)
+					continue;
+
+				uint8_t * const row = map_storage->get_row_pointer(y);
+				uint16_t * const elevation_row
+					= map_storage->get_elevation_row_pointer(y);
+				for (int j = 0; j < n; ++j) {
+					if (not covered[j])
+						continue;
+					// Fragment inputs interpolated as on the GPU
+					const float l0 = float(w0[j] * w.inv_area);
+					const float l1 = float(w1[j] * w.inv_area);
+					const float l2 = float(w2[j] * w.inv_area);
+					const std::size_t v = w.first_vertex;
+					const float elevation
+						= l0 * continents_elevation[v+0]
+						+ l1 * continents_elevation[v+1]
+						+ l2 * continents_elevation[v+2];
+					const vec2 pos
+						= l0 * continents_triangles_pos[v+0]
+						+ l1 * continents_triangles_pos[v+1]
+						+ l2 * continents_triangles_pos[v+2];
+					const vec4 color = shade_continents_fragment(
+							pos, elevation, space_max_f, t);
+					uint8_t * const pixel = row + (beg_x + j)*4;
+					pixel[0] = to_unorm8(color.r);
+					pixel[1] = to_unorm8(color.g);
+					pixel[2] = to_unorm8(color.b);
+					pixel[3] = to_unorm8(color.a);
+					elevation_row[beg_x + j] = to_unorm16(color.a);
+				}
+			}
+		}
+	}
+}
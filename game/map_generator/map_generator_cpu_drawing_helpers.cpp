@@ -3,7 +3,7 @@
 
 #include "map_generator.hpp"
 
-#include <queue>
+#include <cstring>
 
 #include <glm/glm.hpp>
 using namespace glm;
@@ -27,72 +27,136 @@ void map_generator_t::draw_edge(dvec2 beg, dvec2 end,
 
 	dvec2 pos = beg;
 	for (int i = 0; i < iterations_cnt; ++i, pos += off) {
-		if (pos.x < 0 || pos.x >= double(width)
+		int x;
+		if (!map_to_storage_x(pos.x, x)
 				|| pos.y < 0 || pos.y >= double(height))
 			continue;
-		if (!draw_only_empty || map_storage->get_rgb_value(pos.y, pos.x) == 0x0)
-			map_storage->set_rgb_value(pos.y, pos.x, color);
+		if (!draw_only_empty || map_storage->get_rgb_value(pos.y, x) == 0x0)
+			draw_pixel(pos.y, x, color);
 	}
 }
 
-void map_generator_t::draw_point(glm::dvec2 pos, double dim,
-		uint32_t color) {
-
+template<class F>
+void map_generator_t::for_each_point_pixel(glm::dvec2 pos, double dim,
+		const F &f) const {
 	ivec2 beg, end;
-	beg.x = (pos.x-dim/2.0f)*double(width-1)/ratio_wh;
-	end.x = (pos.x+dim/2.0f)*double(width-1)/ratio_wh;
+	beg.x = (pos.x-dim/2.0f)*double(map_width-1)/map_ratio_wh;
+	end.x = (pos.x+dim/2.0f)*double(map_width-1)/map_ratio_wh;
 	beg.y = (pos.y-dim/2.0f)*double(height-1);
 	end.y = (pos.y+dim/2.0f)*double(height-1);
 
-	for (int x = beg.x; x <= end.x; ++x) {
-		if (x < 0 || x >= width) continue;
-
+	for (int map_x = beg.x; map_x <= end.x; ++map_x) {
 		for (int y = beg.y; y <= end.y; ++y) {
 			if (y < 0 || y >= height) continue;
-			map_storage->set_rgb_value(y, x, color);
+			f(y, map_x);
 		}
 	}
 }
 
+void map_generator_t::draw_point(glm::dvec2 pos, double dim,
+		uint32_t color) {
+	for_each_point_pixel(pos, dim, [this, color] (int y, int map_x) {
+		int x;
+		if (map_to_storage_x(map_x, x))
+			draw_pixel(y, x, color);
+	});
+}
+
 void map_generator_t::fill(glm::dvec2 origin,
 		uint32_t fill_color) {
 	origin = space_to_map_coords(origin);
 
-	ivec2 first_pixel(origin.x, origin.y);
-	if (first_pixel.x < 0 || first_pixel.x >= width)
+	ivec2 first_pixel(0, origin.y);
+	if (!map_to_storage_x(origin.x, first_pixel.x))
 		return;
 	if (first_pixel.y < 0 || first_pixel.y >= height)
 		return;
 
-	static const ivec2 dir[] {
-		ivec2(-1, 0),
-		ivec2(1, 0),
-		ivec2(0, -1),
-		ivec2(0, 1)
+	fill_region(first_pixel, fill_color, fill_spans);
+}
+
+void map_generator_t::fill(
+		const std::vector<std::pair<glm::dvec2, uint32_t>> &seeds) {
+	#pragma omp parallel
+	{
+	std::vector<fill_span_t> spans;
+	#pragma omp for schedule (dynamic, 1)
+	for (std::size_t i = 0; i < seeds.size(); ++i) {
+		const dvec2 origin = space_to_map_coords(seeds[i].first);
+		ivec2 first_pixel(0, origin.y);
+		if (!map_to_storage_x(origin.x, first_pixel.x))
+			continue;
+		if (first_pixel.y < 0 || first_pixel.y >= height)
+			continue;
+
+		fill_region(first_pixel, seeds[i].second, spans);
+	}
+	}
+}
+
+// Scanline fill: every maximal black span is filled at once, then only
+// spans of neighboring rows are pushed to the stack. Pixels are accessed
+// as whole 32 bit words, alpha channel is preserved.
+void map_generator_t::fill_region(glm::ivec2 first_pixel,
+		uint32_t fill_color, std::vector<fill_span_t> &spans) {
+	const uint8_t rgb_mask_bytes[4] {0xff, 0xff, 0xff, 0x00};
+	const uint8_t fill_bytes[4] {
+		static_cast<uint8_t>((fill_color & 0xff0000) >> 16),
+		static_cast<uint8_t>((fill_color & 0x00ff00) >> 8),
+		static_cast<uint8_t>((fill_color & 0x0000ff) >> 0),
+		0x00
+	};
+	uint32_t rgb_mask, fill_word;
+	std::memcpy(&rgb_mask, rgb_mask_bytes, 4);
+	std::memcpy(&fill_word, fill_bytes, 4);
+
+	const auto is_empty = [rgb_mask] (const uint8_t *row, int x) {
+		uint32_t word;
+		std::memcpy(&word, row + x*4, 4);
+		return (word & rgb_mask) == 0;
+	};
+	const auto fill_span = [rgb_mask, fill_word] (
+			uint8_t *row, int beg_x, int end_x) {
+		for (int x = beg_x; x <= end_x; ++x) {
+			uint32_t word;
+			std::memcpy(&word, row + x*4, 4);
+			word = (word & ~rgb_mask) | fill_word;
+			std::memcpy(row + x*4, &word, 4);
+		}
+	};
+	// Fills the maximal black span containing x, x has to be black
+	const auto fill_maximal_span
+		= [this, &is_empty, &fill_span, &spans] (
+				uint8_t *row, int y, int x) -> int {
+		int beg_x = x, end_x = x;
+		while (beg_x > 0 && is_empty(row, beg_x-1))
+			--beg_x;
+		while (end_x+1 < width && is_empty(row, end_x+1))
+			++end_x;
+		fill_span(row, beg_x, end_x);
+		spans.push_back({y, beg_x, end_x});
+		return end_x;
 	};
 
-	std::queue<ivec2> next_pixel;
-	next_pixel.push(first_pixel);
-	map_storage->set_rgb_value(first_pixel.y, first_pixel.x, fill_color);
+	uint8_t *first_row = map_storage->get_row_pointer(first_pixel.y);
+	if (!is_empty(first_row, first_pixel.x))
+		return;
 
-	while (!next_pixel.empty()) {
-		ivec2 pixel = next_pixel.front();
-		next_pixel.pop();
+	spans.clear();
+	fill_maximal_span(first_row, first_pixel.y, first_pixel.x);
 
-		for (int i = 0; i < 4; ++i) {
-			const ivec2 d = dir[i];
-			const ivec2 p = pixel+d;
-			if (p.x < 0 || p.x >= width)
-				continue;
-			if (p.y < 0 || p.y >= height)
-				continue;
+	while (!spans.empty()) {
+		const fill_span_t span = spans.back();
+		spans.pop_back();
 
-			const uint32_t cur_color = map_storage->get_rgb_value(p.y, p.x);
-			if (cur_color != 0x000000)
+		for (const int y : {span.y-1, span.y+1}) {
+			if (y < 0 || y >= height)
 				continue;
-
-			next_pixel.push(p);
-			map_storage->set_rgb_value(p.y, p.x, fill_color);
+			uint8_t *row = map_storage->get_row_pointer(y);
+			for (int x = span.beg_x; x <= span.end_x; ++x) {
+				if (is_empty(row, x))
+					x = fill_maximal_span(row, y, x);
+			}
 		}
 	}
 }
@@ -133,8 +197,11 @@ void map_generator_t::draw_convex_polygon(
 					break;
 				}
 			}
-			if (inside && map_storage->get_rgb_value(y, x) == 0x0)
-				map_storage->set_rgb_value(y, x, color);
+			int storage_x;
+			if (!inside || !map_to_storage_x(x, storage_x))
+				continue;
+			if (map_storage->get_rgb_value(y, storage_x) == 0x0)
+				map_storage->set_rgb_value(y, storage_x, color);
 		}
 	}
 }
@@ -23,68 +23,33 @@ using namespace glm;
 #include "noise.hpp"
 #include <delaunator.hpp>
 
-double spline(double t, const std::function<double(const long long)> &f) {
-	const double floor_t = std::floor(t);
-
-	const long long p1 = static_cast<long long>(floor_t) + 0;
-	const long long p2 = p1 + 1;
-	const long long p3 = p2 + 1;
-	const long long p0 = p1 - 1;
-
-	t -= floor_t;
-	const double tt = t * t;
-	const double ttt = tt * t;
-
-	const double q1 = -ttt + 2.0f*tt - t;
-	const double q2 = 3.0f*ttt - 5.0f*tt + 2.0f;
-	const double q3 = -3.0f*ttt + 4.0f*tt + t;
-	const double q4 = ttt - tt;
-
-	const double res
-		= 0.5 * (
-			f(p0) * q1 + f(p1) * q2 + f(p2) * q3 + f(p3) * q4
-			);
-
-	return res;
-}
-
-double spline_gradient(
-		double t, const std::function<double(const long long)> &f) {
-	const double floor_t = std::floor(t);
-
-	const long long p1 = static_cast<long long>(floor_t) + 0;
-	const long long p2 = p1 + 1;
-	const long long p3 = p2 + 1;
-	const long long p0 = p1 - 1;
-
-	t -= floor_t;
-	const double tt = t * t;
-
-	const double q1 = -3.0 * tt + 4.0*t - 1;
-	const double q2 = 9.0*tt - 10.0*t;
-	const double q3 = -9.0*tt + 8.0*t + 1.0;
-	const double q4 = 3.0*tt - 2.0*t;
-
-	const double res
-		= 0.5 * (
-			f(p0) * q1 + f(p1) * q2 + f(p2) * q3 + f(p3) * q4
-			);
-
-	return res;
+std::pair<glm::dvec2, glm::dvec2>
+map_generator_t::get_tour_path_points(const double off) const {
+	std::pair<dvec2, dvec2> points;
+	get_tour_path_points(std::span(&off, 1), std::span(&points, 1));
+	return points;
 }
 
-std::pair<glm::dvec2, glm::dvec2>
-map_generator_t::get_tour_path_points(const double off) {
-	const dvec2 pos(
-			spline(off, get_tour_path_point_x),
-			spline(off, get_tour_path_point_y)
-			);
-	const dvec2 gradient(
-			spline_gradient(off, get_tour_path_point_x),
-			spline_gradient(off, get_tour_path_point_y)
-			);
+void map_generator_t::get_tour_path_points(std::span<const double> offs,
+		std::span<std::pair<glm::dvec2, glm::dvec2>> points) const {
+	assert(offs.size() == points.size());
+	long long segment = std::numeric_limits<long long>::min();
+	dvec2 control_points[4];
+	const auto get_control_point = [&] (const long long id) {
+		return control_points[id - segment + 1];
+	};
 
-	return { pos, gradient };
+	for (std::size_t i = 0; i < offs.size(); ++i) {
+		const spline_weights_t weights = get_spline_weights(offs[i]);
+		if (weights.p1 != segment) {
+			segment = weights.p1;
+			for (long long j = 0; j < 4; ++j)
+				control_points[j] = get_tour_path_point(segment-1 + j);
+		}
+		points[i].first = weights.apply(get_control_point);
+		points[i].second
+			= get_spline_gradient_weights(offs[i]).apply(get_control_point);
+	}
 }
 
 void map_generator_t::draw_tour_path([[maybe_unused]] std::mt19937 &gen) {
@@ -347,87 +312,16 @@ void map_generator_t::draw_tour_path([[maybe_unused]] std::mt19937 &gen) {
 		tour_path_points[i].y = chosen_points_coords[2*cycle[i]+1];
 	}
 
+	// Copies of the path wrap onto the same pixels of the single copy map
+	std::vector<double> offs;
 	for (
-		double t = -static_cast<double>(cycle.size());
-		t <= static_cast<double>(2*cycle.size()-1);
+		double t = map_single_copy ? 0.0 : -static_cast<double>(cycle.size());
+		t <= static_cast<double>(
+				map_single_copy ? cycle.size() : 2*cycle.size()-1);
 		t += 0.01)
-	{
-		draw_point(
-			dvec2(
-				spline(t, get_tour_path_point_x),
-				spline(t, get_tour_path_point_y)),
-			0.001,
-			0xcc99a1
-			);
-	}
-
-	// for (std::size_t i = 0; ; ++i) {
-	// 	draw_point(
-	// 		map_storage,
-	// 		dvec2(
-	// 			get_tour_path_point_x(static_cast<long long>(i)
-	// 				+ static_cast<long long>(cycle.size())),
-	// 			get_tour_path_point_y(static_cast<long long>(i)
-	// 				+ static_cast<long long>(cycle.size()))),
-	// 		0.01,
-	// 		0xef6b81
-	// 		);
-
-	// 	draw_point(
-	// 		map_storage,
-	// 		dvec2(
-	// 			get_tour_path_point_x(static_cast<long long>(i)
-	// 				- static_cast<long long>(cycle.size())),
-	// 			get_tour_path_point_y(static_cast<long long>(i)
-	// 				- static_cast<long long>(cycle.size()))),
-	// 		0.01,
-	// 		0xef6b81
-	// 		);
-
-	// 	draw_point(
-	// 		map_storage,
-	// 		dvec2(
-	// 			get_tour_path_point_x(static_cast<long long>(i)),
-	// 			get_tour_path_point_y(static_cast<long long>(i))),
-	// 		0.01,
-	// 		0xef6b81
-	// 		);
-
-	// 	if (i+1 == cycle.size())
-	// 		break;
-
-	// 	// draw_edge(map_storage,
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+0]+0],
-	// 	// 		chosen_points_coords[2*cycle[i+0]+1]),
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+1]+0],
-	// 	// 		chosen_points_coords[2*cycle[i+1]+1]),
-	// 	// 	0x9e0922
-	// 	// 	);
-
-	// 	// draw_edge(map_storage,
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+0]+0]
-	// 	// 		- duplicate_off_x,
-	// 	// 		chosen_points_coords[2*cycle[i+0]+1]),
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+1]+0]
-	// 	// 		- duplicate_off_x,
-	// 	// 		chosen_points_coords[2*cycle[i+1]+1]),
-	// 	// 	0x9e0922
-	// 	// 	);
-
-	// 	// draw_edge(map_storage,
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+0]+0]
-	// 	// 		+ duplicate_off_x,
-	// 	// 		chosen_points_coords[2*cycle[i+0]+1]),
-	// 	// 	dvec2(
-	// 	// 		chosen_points_coords[2*cycle[i+1]+0]
-	// 	// 		+ duplicate_off_x,
-	// 	// 		chosen_points_coords[2*cycle[i+1]+1]),
-	// 	// 	0x9e0922
-	// 	// 	);
-	// }
+		offs.push_back(t);
+	std::vector<std::pair<dvec2, dvec2>> points(offs.size());
+	get_tour_path_points(offs, points);
+	for (const std::pair<dvec2, dvec2> &point : points)
+		draw_point(point.first, 0.001, 0xcc99a1);
 }
@@ -0,0 +1,103 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "map_regenerator.hpp"
+
+#include <algorithm>
+
+map_regenerator_t::map_regenerator_t(map_storage_t &front)
+	:front{front}
+	,generator{&back, settings}
+	,worker{&map_regenerator_t::work, this}
+{  }
+
+map_regenerator_t::~map_regenerator_t() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+		cancel = true;
+	}
+	state_changed.notify_all();
+	worker.join();
+}
+
+void map_regenerator_t::request() {
+	assert(front.has_cpu_memory());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested_settings = global_settings;
+		requested = true;
+		// A finished map not swapped yet is outdated as well
+		finished = false;
+		cancel = true;
+	}
+	state_changed.notify_all();
+}
+
+bool map_regenerator_t::update() {
+	bool swapped = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// The worker does not touch the back buffer until the next request
+		if (finished) {
+			finished = false;
+			if (back.get_width() != front.get_width()
+					or back.get_height() != front.get_height()) {
+				// The drawn texture is resized along with the copy
+				front.load_settings(settings);
+				front.reallocate_cpu_memory();
+			}
+			if (back.get_width() == front.get_width()
+					and back.get_height() == front.get_height()) {
+				front.swap_cpu_memory(back);
+				back_swapped = true;
+				front_voronoi_seed = generator.get_current_voronoi_seed();
+				upload_beg_y = 0;
+				upload_end_y = front.get_height();
+				swapped = true;
+			}
+		}
+	}
+
+	if (upload_beg_y < upload_end_y) {
+		const int end_y = std::min(upload_end_y,
+				upload_beg_y + UPLOAD_BAND_HEIGHT);
+		front.load_rows_to_staging_texture(upload_beg_y, end_y);
+		upload_beg_y = end_y;
+		if (upload_beg_y == upload_end_y)
+			front.copy_staging_texture();
+	}
+	return swapped;
+}
+
+void map_regenerator_t::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		state_changed.wait(lock, [this] () {
+			return requested or quitting;
+		});
+		if (quitting)
+			return;
+		requested = false;
+		generating = true;
+		cancel = false;
+		settings = requested_settings;
+		if (back_swapped) {
+			back_swapped = false;
+			generator.invalidate_map();
+		}
+		lock.unlock();
+
+		back.load_settings(settings);
+		back.reallocate_cpu_memory();
+		generator.load_settings();
+		generator.new_seed();
+		const bool done = generator.generate_map_in_cpu_memory(&cancel);
+
+		lock.lock();
+		generating = false;
+		// Newer requests have cancelled this one or are about to replace it
+		if (done and not requested)
+			finished = true;
+	}
+}
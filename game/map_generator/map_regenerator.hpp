@@ -0,0 +1,84 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef MAP_REGENERATOR_HPP
+#define MAP_REGENERATOR_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "map_storage.hpp"
+#include "map_generator.hpp"
+
+// Regenerates the map on a worker thread into a back buffer, while the front
+// buffer stays in use. A newer request cancels the one in progress between
+// the generation stages. The finished map is swapped into the front buffer.
+// Its texture is uploaded to a staging texture a band of rows per update,
+// the drawn texture is replaced once all rows are uploaded.
+// The settings are copied by `request`, the worker thread never reads
+// global_settings, so they may change during a regeneration.
+// The changes are used by the next request.
+struct map_regenerator_t {
+	map_regenerator_t(map_storage_t &front);
+	~map_regenerator_t();
+
+	// The front buffer has to have the CPU memory
+	void request();
+	// Called every frame from the thread owning the OpenGL context. Returns
+	// true if a finished map has just been swapped into the front buffer.
+	// The front buffer is resized from the settings if the map's size
+	// differs, maps of other sizes are dropped.
+	bool update();
+	// Whether a map is being generated or uploaded
+	inline bool is_busy() const;
+	// Seed of the map in the front buffer, valid after the first swap
+	inline std::mt19937::result_type get_front_voronoi_seed() const;
+
+private:
+	static constexpr int UPLOAD_BAND_HEIGHT = 64;
+
+	void work();
+
+	map_storage_t &front;
+	map_storage_t back;
+	// Settings of the map being generated, written by the worker thread
+	// under the mutex when it takes a request
+	settings_t settings;
+	map_generator_t generator;
+	std::mt19937::result_type front_voronoi_seed = 0;
+	// Rows of the front texture left to upload start here
+	int upload_beg_y = 0;
+	int upload_end_y = 0;
+
+	// State shared with the worker is guarded by the mutex, except for
+	// the cancel flag polled during generation
+	mutable std::mutex mutex;
+	std::condition_variable state_changed;
+	settings_t requested_settings;
+	bool requested = false;
+	bool generating = false;
+	bool finished = false;
+	bool quitting = false;
+	// The back buffer's content was swapped out since the last generation
+	bool back_swapped = false;
+	std::atomic<bool> cancel{false};
+	// Declared last, so that the thread starts after the members above
+	// are constructed
+	std::thread worker;
+};
+
+inline bool map_regenerator_t::is_busy() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return requested or generating or finished
+		or upload_beg_y < upload_end_y;
+}
+
+inline std::mt19937::result_type
+map_regenerator_t::get_front_voronoi_seed() const {
+	return front_voronoi_seed;
+}
+
+#endif
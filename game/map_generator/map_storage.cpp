@@ -3,50 +3,87 @@
 
 #include "map_storage.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 #include <settings.hpp>
 #include <useful.hpp>
 #include <shader_loader.hpp>
 
-void map_storage_t::load_settings() {
+void map_storage_t::load_settings(const settings_t &settings) {
 	desired_width
-		= global_settings.map_unit_resolution
-		* global_settings.map_width_in_units;
-	if (global_settings.triple_map_size)
+		= settings.map_unit_resolution
+		* settings.map_width_in_units;
+	if (settings.triple_map_size)
 		desired_width *= 3;
 	desired_height
-		= global_settings.map_unit_resolution
-		* global_settings.map_height_in_units;
+		= settings.map_unit_resolution
+		* settings.map_height_in_units;
 }
 
-void map_storage_t::reallocate_gpu_and_cpu_memory() {
+void map_storage_t::reallocate_gpu_and_cpu_memory(bool allocate_cpu_memory) {
 	const int prev_width = width;
 	const int prev_height = height;
 	const int new_width = desired_width;
 	const int new_height = desired_height;
 
 	if (prev_width != new_width or
-			prev_height != new_height) {
-		if (content)
-			delete[] content;
-		if (new_width*new_height > 0)
-			content = new uint8_t[new_width*new_height*4];
-		else
-			content = nullptr;
-
+			prev_height != new_height or
+			allocate_cpu_memory != (content != nullptr)) {
+		discard_pending_bands();
+		assign_cpu_memory(new_width, new_height, allocate_cpu_memory);
+	}
+	// The CPU memory may have been resized alone by reallocate_cpu_memory
+	if (texture_width != new_width or texture_height != new_height) {
 		glBindTexture(GL_TEXTURE_2D, get_texture_id());
 		GL_GET_ERROR;
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, new_width, new_height, 0,
 				GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 		// glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
 		GL_GET_ERROR;
+		texture_width = new_width;
+		texture_height = new_height;
 	}
 
 	width = desired_width;
 	height = desired_height;
 }
 
+void map_storage_t::reallocate_cpu_memory() {
+	if (width != desired_width or height != desired_height
+			or content == nullptr) {
+		discard_pending_bands();
+		assign_cpu_memory(desired_width, desired_height, true);
+	}
+	width = desired_width;
+	height = desired_height;
+}
+
+void map_storage_t::assign_cpu_memory(int new_width, int new_height,
+		bool allocate) {
+	if (content)
+		delete[] content;
+	if (allocate and new_width*new_height > 0)
+		content = new uint8_t[new_width*new_height*4];
+	else
+		content = nullptr;
+	const std::size_t planes_size = content ?
+		std::size_t(new_width)*new_height : 0;
+	elevation_plane.assign(planes_size, 0);
+	humidity_plane.assign(planes_size, 0);
+	temperature_plane.assign(planes_size, 0);
+}
+
+void map_storage_t::swap_cpu_memory(map_storage_t &other) {
+	assert(width == other.width and height == other.height);
+	assert(pending_bands.empty() and other.pending_bands.empty());
+	std::swap(content, other.content);
+	elevation_plane.swap(other.elevation_plane);
+	humidity_plane.swap(other.humidity_plane);
+	temperature_plane.swap(other.temperature_plane);
+}
+
 void map_storage_t::init_gl() {
 	// Load shaders and generate shader program
 	GLuint vertex_shader_id = compile_shader(
@@ -97,7 +134,15 @@ void map_storage_t::init_gl() {
 	// Generate texture
 	glGenTextures(1, &texture_id);
 	glBindTexture(GL_TEXTURE_2D, get_texture_id());
+	set_texture_parameters();
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Generate pixel buffers, they are allocated by the transfers
+	glGenBuffers(1, &pack_buffer_id);
+	glGenBuffers(1, &unpack_buffer_id);
+}
 
+void map_storage_t::set_texture_parameters() {
 	// Set the texture wrapping/filtering options
 	// (on the currently bound texture object)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -110,14 +155,21 @@ void map_storage_t::init_gl() {
 			// GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
 			GL_NEAREST);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void map_storage_t::deinit_gl() {
+	discard_pending_bands();
+	glDeleteBuffers(1, &pack_buffer_id);
+	glDeleteBuffers(1, &unpack_buffer_id);
 	glDeleteBuffers(1, &quad_positions_buffer_id);
 	glDeleteBuffers(1, &quad_uvs_buffer_id);
 	glDeleteVertexArrays(1, &vao_id);
 	glDeleteTextures(1, &texture_id);
+	if (staging_texture_id != 0)
+		glDeleteTextures(1, &staging_texture_id);
+	staging_texture_id = 0;
+	texture_width = texture_height = 0;
+	staging_texture_width = staging_texture_height = 0;
 	delete_program(program_id);
 }
 
@@ -133,20 +185,202 @@ void map_storage_t::clear() {
 			get_component_reference(y, x, 3) = 0;
 		}
 	}
+	std::fill(elevation_plane.begin(), elevation_plane.end(), 0);
+	clear_climate_planes();
+}
+
+void map_storage_t::clear_climate_planes() {
+	std::fill(humidity_plane.begin(), humidity_plane.end(), 0);
+	std::fill(temperature_plane.begin(), temperature_plane.end(), 0);
 }
 
 void map_storage_t::load_from_cpu_to_gpu_memory() {
-	glBindTexture(GL_TEXTURE_2D, get_texture_id());
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
-			GL_RGBA, GL_UNSIGNED_BYTE, content);
+	for (int beg_y = 0; beg_y < height; beg_y += TRANSFER_BAND_HEIGHT)
+		load_rows_from_cpu_to_gpu_memory(
+				beg_y, std::min(beg_y + TRANSFER_BAND_HEIGHT, height));
+}
+
+void map_storage_t::load_rows_from_cpu_to_gpu_memory(int beg_y, int end_y) {
+	upload_rows(get_texture_id(), beg_y, end_y);
+}
+
+void map_storage_t::load_rows_to_staging_texture(int beg_y, int end_y) {
+	if (staging_texture_id == 0) {
+		glGenTextures(1, &staging_texture_id);
+		glBindTexture(GL_TEXTURE_2D, staging_texture_id);
+		set_texture_parameters();
+	}
+	if (staging_texture_width != width or staging_texture_height != height) {
+		glBindTexture(GL_TEXTURE_2D, staging_texture_id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		GL_GET_ERROR;
+		staging_texture_width = width;
+		staging_texture_height = height;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	upload_rows(staging_texture_id, beg_y, end_y);
+}
+
+void map_storage_t::copy_staging_texture() {
+	assert(staging_texture_id != 0);
+	if (texture_width != staging_texture_width
+			or texture_height != staging_texture_height) {
+		glBindTexture(GL_TEXTURE_2D, get_texture_id());
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+				staging_texture_width, staging_texture_height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		texture_width = staging_texture_width;
+		texture_height = staging_texture_height;
+	}
+	glCopyImageSubData(
+			staging_texture_id, GL_TEXTURE_2D, 0, 0, 0, 0,
+			get_texture_id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+			texture_width, texture_height, 1);
+	GL_GET_ERROR;
+}
+
+void map_storage_t::upload_rows(GLuint texture, int beg_y, int end_y) {
+	if (content == nullptr)
+		return;
+	assert(0 <= beg_y and beg_y <= end_y and end_y <= height);
+	if (beg_y == end_y)
+		return;
+	const GLsizeiptr size = GLsizeiptr(end_y - beg_y)*width*4;
+
+	// The buffer holds a single band. Respecifying it orphans the storage
+	// of the previous band, so that the copy does not wait for the GPU
+	// still reading from it.
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer_id);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (dst) {
+		std::memcpy(dst, get_row_pointer(beg_y), size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	// The rows are read from the bound buffer at offset 0
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, beg_y, width, end_y - beg_y,
+			GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
 	// glGenerateMipmap(GL_TEXTURE_2D);
-	// WHERE; PRINT_U(glGetError());
 	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	GL_GET_ERROR;
 }
 
 void map_storage_t::load_from_gpu_to_cpu_memory() {
-	glGetTextureImage(get_texture_id(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
-			width*height*4, content);
+	start_loading_from_gpu_to_cpu_memory(
+			std::min(TRANSFER_BAND_HEIGHT, height));
+	wait_for_loaded_rows(height);
+}
+
+void map_storage_t::start_loading_from_gpu_to_cpu_memory(int band_height,
+		band_loaded_callback_t on_band_loaded) {
+	assert(content != nullptr);
+	assert(band_height > 0);
+	discard_pending_bands();
+	this->on_band_loaded = std::move(on_band_loaded);
+	loaded_rows_cnt = 0;
+	readback_band_height = band_height;
+	next_readback_beg_y = 0;
+
+	// The pack buffer is a ring of band sized slots, a slot is reused for
+	// the next band once its band is copied
+	const int slots_cnt = std::min(PACK_RING_SLOTS_CNT,
+			ceil_div(height, band_height));
+	const GLsizeiptr slot_size = GLsizeiptr(band_height)*width*4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer_id);
+	if (pack_buffer_size != slot_size*slots_cnt) {
+		pack_buffer_size = slot_size*slots_cnt;
+		glBufferData(GL_PIXEL_PACK_BUFFER, pack_buffer_size, NULL,
+				GL_STREAM_READ);
+	}
+	// Every band gets its own fence, so that the first rows can be used
+	// before the whole texture is transferred
+	for (int slot = 0; slot < slots_cnt; ++slot)
+		start_loading_next_band(slot*slot_size);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glFlush();
+	GL_GET_ERROR;
+}
+
+void map_storage_t::start_loading_next_band(GLintptr buffer_offset) {
+	if (next_readback_beg_y >= height)
+		return;
+	const int beg_y = next_readback_beg_y;
+	const int end_y = std::min(beg_y + readback_band_height, height);
+	const GLsizei size = (end_y - beg_y)*width*4;
+	glGetTextureSubImage(get_texture_id(), 0,
+			0, beg_y, 0, width, end_y - beg_y, 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, size,
+			reinterpret_cast<void*>(buffer_offset));
+	pending_bands.push_back({beg_y, end_y, buffer_offset,
+			glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+	next_readback_beg_y = end_y;
+}
+
+int map_storage_t::poll_loading_from_gpu_to_cpu_memory() {
+	while (not pending_bands.empty()) {
+		const GLenum status
+			= glClientWaitSync(pending_bands.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED and status != GL_CONDITION_SATISFIED)
+			break;
+		copy_loaded_band();
+	}
+	return loaded_rows_cnt;
+}
+
+void map_storage_t::wait_for_loaded_rows(int end_y) {
+	while (loaded_rows_cnt < end_y and not pending_bands.empty()) {
+		GLenum status;
+		do {
+			status = glClientWaitSync(pending_bands.front().fence,
+					GL_SYNC_FLUSH_COMMANDS_BIT, SYNC_WAIT_TIMEOUT_NS);
+		} while (status == GL_TIMEOUT_EXPIRED);
+		copy_loaded_band();
+	}
+}
+
+void map_storage_t::copy_loaded_band() {
+	const band_transfer_t band = pending_bands.front();
+	pending_bands.pop_front();
+	glDeleteSync(band.fence);
+
+	const GLsizeiptr size = GLsizeiptr(band.end_y - band.beg_y)*width*4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer_id);
+	const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+			band.buffer_offset, size, GL_MAP_READ_BIT);
+	if (src) {
+		std::memcpy(get_row_pointer(band.beg_y), src, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	// The slot is free for the next band
+	start_loading_next_band(band.buffer_offset);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glFlush();
+
+	// The GPU generator outputs only the elevation byte in the alpha
+	// channel, 0xff is scaled to MAX_ELEVATION
+	for (int y = band.beg_y; y < band.end_y; ++y) {
+		const uint8_t * const row = get_row_pointer(y);
+		uint16_t * const elevation_row = get_elevation_row_pointer(y);
+		for (int x = 0; x < width; ++x)
+			elevation_row[x] = uint16_t(row[x*4 + 3]) * 0x101;
+	}
+
+	loaded_rows_cnt = band.end_y;
+	if (on_band_loaded)
+		on_band_loaded(band.beg_y, band.end_y);
+}
+
+void map_storage_t::discard_pending_bands() {
+	for (const band_transfer_t &band : pending_bands)
+		glDeleteSync(band.fence);
+	pending_bands.clear();
+	on_band_loaded = nullptr;
 }
 
 void map_storage_t::draw(const glm::mat4 &MVP_matrix) {
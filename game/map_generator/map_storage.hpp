@@ -9,14 +9,28 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <deque>
+#include <vector>
+#include <functional>
+
 #include <settings.hpp>
 
 struct map_storage_t {
+	// Called with the rows [beg_y, end_y) which arrived in the CPU memory
+	typedef std::function<void(int beg_y, int end_y)> band_loaded_callback_t;
+
 	// Basic usage functions
 	map_storage_t() = default;
-	void load_settings();
+	void load_settings(const settings_t &settings = global_settings);
 	void init_gl();
-	void reallocate_gpu_and_cpu_memory();
+	// CPU memory is not needed if the map is read from map_tiles_t
+	void reallocate_gpu_and_cpu_memory(bool allocate_cpu_memory = true);
+	// No OpenGL call is made without readbacks in flight, the texture keeps
+	// its size until it is reallocated or the staging texture is copied
+	void reallocate_cpu_memory();
+	// Exchanges the CPU memory, sizes have to be equal. Textures are not
+	// exchanged.
+	void swap_cpu_memory(map_storage_t &other);
 	void draw(const glm::mat4 &MVP_matrix);
 	void deinit_gl();
 	~map_storage_t();
@@ -30,10 +44,58 @@ struct map_storage_t {
 	inline uint8_t get_component_value(int y, int x, int component) const;
 	inline void set_rgb_value(int y, int x, uint32_t color);
 	inline void set_rgb_value(int y, int x, glm::u8vec3 color);
+	// Raw RGBA bytes of the row y, 4 bytes per pixel
+	inline uint8_t* get_row_pointer(int y);
+	inline bool has_cpu_memory() const;
 	void clear();
+	inline GLuint get_texture_id() const;
+
+	// Planes of values stored next to the displayed RGBA content, one value
+	// per pixel and rows one after another. They exist only along with the
+	// CPU memory and are never sent to the GPU.
+	static constexpr uint16_t MAX_ELEVATION = 0xffff;
+	inline uint16_t& get_elevation_reference(int y, int x);
+	inline uint16_t get_elevation_value(int y, int x) const;
+	inline uint16_t* get_elevation_row_pointer(int y);
+	inline const uint16_t* get_elevation_row_pointer(int y) const;
+	inline uint8_t& get_humidity_reference(int y, int x);
+	inline uint8_t get_humidity_value(int y, int x) const;
+	inline uint8_t* get_humidity_row_pointer(int y);
+	inline const uint8_t* get_humidity_row_pointer(int y) const;
+	inline uint8_t& get_temperature_reference(int y, int x);
+	inline uint8_t get_temperature_value(int y, int x) const;
+	inline uint8_t* get_temperature_row_pointer(int y);
+	inline const uint8_t* get_temperature_row_pointer(int y) const;
+	void clear_climate_planes();
+
+	// Transfers go through pixel buffer objects holding a few bands of rows
+	// at most. The upload returns as soon as the content is copied into
+	// the buffer.
 	void load_from_cpu_to_gpu_memory();
+	// Uploads the rows [beg_y, end_y) only
+	void load_rows_from_cpu_to_gpu_memory(int beg_y, int end_y);
+	// Same as above, but into a staging texture, the drawn one does not
+	// change until copy_staging_texture. Rows uploaded in many frames are
+	// shown all at once.
+	void load_rows_to_staging_texture(int beg_y, int end_y);
+	// Copies the staging texture into the drawn one on the GPU, resizing
+	// the latter if needed
+	void copy_staging_texture();
+	// Blocking readback of the whole texture
 	void load_from_gpu_to_cpu_memory();
-	inline GLuint get_texture_id() const;
+	// Asynchronous readback in bands of band_height rows. Bands arrive in
+	// order and on_band_loaded is called for each of them from
+	// poll_loading_from_gpu_to_cpu_memory or wait_for_loaded_rows.
+	// At most PACK_RING_SLOTS_CNT bands are in flight at once.
+	void start_loading_from_gpu_to_cpu_memory(int band_height,
+			band_loaded_callback_t on_band_loaded = nullptr);
+	// Copies the bands finished by the GPU, returns the loaded rows count
+	int poll_loading_from_gpu_to_cpu_memory();
+	// Blocks until the rows [0, end_y) are loaded, returns immediately if
+	// there is no readback in flight
+	void wait_for_loaded_rows(int end_y);
+	inline bool is_loading_from_gpu_to_cpu_memory() const;
+	inline int get_loaded_rows_cnt() const;
 
 private:
 	int desired_width;
@@ -41,8 +103,18 @@ private:
 	int width = 0;
 	int height = 0;
 	uint8_t *content = nullptr;
+	std::vector<uint16_t> elevation_plane;
+	std::vector<uint8_t> humidity_plane;
+	std::vector<uint8_t> temperature_plane;
 
 	GLuint texture_id;
+	// Allocated by the first upload to the staging texture
+	GLuint staging_texture_id = 0;
+	// Sizes the textures have been allocated with
+	int texture_width = 0;
+	int texture_height = 0;
+	int staging_texture_width = 0;
+	int staging_texture_height = 0;
 	GLuint program_id;
 
 	GLuint vao_id;
@@ -52,6 +124,33 @@ private:
 	GLuint texture_sampler_uniform;
 	GLuint MVP_matrix_uniform;
 
+	// Pixel buffer objects and the state of the asynchronous readback
+	struct band_transfer_t {
+		int beg_y;
+		int end_y;
+		// Slot of the pack buffer
+		GLintptr buffer_offset;
+		GLsync fence;
+	};
+	static constexpr GLuint64 SYNC_WAIT_TIMEOUT_NS = 1'000'000;
+	static constexpr int TRANSFER_BAND_HEIGHT = 64;
+	static constexpr int PACK_RING_SLOTS_CNT = 4;
+	GLuint pack_buffer_id;
+	GLuint unpack_buffer_id;
+	GLsizeiptr pack_buffer_size = 0;
+	std::deque<band_transfer_t> pending_bands;
+	band_loaded_callback_t on_band_loaded;
+	int loaded_rows_cnt = 0;
+	int readback_band_height = 0;
+	int next_readback_beg_y = 0;
+	void upload_rows(GLuint texture, int beg_y, int end_y);
+	// Sets the texture's parameters, it has to be bound
+	void set_texture_parameters();
+	void start_loading_next_band(GLintptr buffer_offset);
+	void copy_loaded_band();
+	void discard_pending_bands();
+	void assign_cpu_memory(int new_width, int new_height, bool allocate);
+
 	static constexpr GLfloat quad_positions[] {
 		-1, -1, 0,
 		-1, 1, 0,
@@ -122,8 +221,92 @@ inline void map_storage_t::set_rgb_value(int y, int x, glm::u8vec3 color) {
 	get_component_reference(y, x, 0) = color.b;
 }
 
+inline uint8_t* map_storage_t::get_row_pointer(int y) {
+	assert(0 <= y && y < height);
+	return content + y*width*4;
+}
+
+inline bool map_storage_t::has_cpu_memory() const {
+	return content != nullptr;
+}
+
+inline uint16_t& map_storage_t::get_elevation_reference(int y, int x) {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return elevation_plane[y*width + x];
+}
+
+inline uint16_t map_storage_t::get_elevation_value(int y, int x) const {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return elevation_plane[y*width + x];
+}
+
+inline uint16_t* map_storage_t::get_elevation_row_pointer(int y) {
+	assert(0 <= y && y < height);
+	return elevation_plane.data() + y*width;
+}
+
+inline const uint16_t* map_storage_t::get_elevation_row_pointer(int y) const {
+	assert(0 <= y && y < height);
+	return elevation_plane.data() + y*width;
+}
+
+inline uint8_t& map_storage_t::get_humidity_reference(int y, int x) {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return humidity_plane[y*width + x];
+}
+
+inline uint8_t map_storage_t::get_humidity_value(int y, int x) const {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return humidity_plane[y*width + x];
+}
+
+inline uint8_t* map_storage_t::get_humidity_row_pointer(int y) {
+	assert(0 <= y && y < height);
+	return humidity_plane.data() + y*width;
+}
+
+inline const uint8_t* map_storage_t::get_humidity_row_pointer(int y) const {
+	assert(0 <= y && y < height);
+	return humidity_plane.data() + y*width;
+}
+
+inline uint8_t& map_storage_t::get_temperature_reference(int y, int x) {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return temperature_plane[y*width + x];
+}
+
+inline uint8_t map_storage_t::get_temperature_value(int y, int x) const {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	return temperature_plane[y*width + x];
+}
+
+inline uint8_t* map_storage_t::get_temperature_row_pointer(int y) {
+	assert(0 <= y && y < height);
+	return temperature_plane.data() + y*width;
+}
+
+inline const uint8_t* map_storage_t::get_temperature_row_pointer(
+		int y) const {
+	assert(0 <= y && y < height);
+	return temperature_plane.data() + y*width;
+}
+
 inline GLuint map_storage_t::get_texture_id() const {
 	return texture_id;
 }
 
+inline bool map_storage_t::is_loading_from_gpu_to_cpu_memory() const {
+	return not pending_bands.empty();
+}
+
+inline int map_storage_t::get_loaded_rows_cnt() const {
+	return loaded_rows_cnt;
+}
+
 #endif
@@ -0,0 +1,61 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "map_tiles.hpp"
+
+#include <settings.hpp>
+
+void map_tiles_t::load_settings() {
+	width
+		= global_settings.map_unit_resolution
+		* global_settings.map_width_in_units;
+	height
+		= global_settings.map_unit_resolution
+		* global_settings.map_height_in_units;
+	tiles_x_cnt = ceil_div(width, TILE_DIM);
+	tiles_y_cnt = ceil_div(height, TILE_DIM);
+	max_cached_tiles_cnt = global_settings.max_cached_map_tiles;
+	clear();
+}
+
+void map_tiles_t::set_tile_generator(tile_generator_t tile_generator) {
+	this->tile_generator = tile_generator;
+	clear();
+}
+
+void map_tiles_t::clear() {
+	tiles.clear();
+	lru_list.clear();
+	last_tile_id = INVALID_ID;
+	last_tile_content = nullptr;
+}
+
+const uint8_t* map_tiles_t::get_tile_content(std::size_t tile_id) {
+	auto it = tiles.find(tile_id);
+	if (it != tiles.end()) {
+		lru_list.splice(lru_list.begin(), lru_list, it->second.lru_it);
+		return it->second.content.data();
+	}
+
+	// Evicting the least recently used tile, its buffer is reused
+	std::vector<uint8_t> content;
+	if (tiles.size() >= max_cached_tiles_cnt) {
+		const std::size_t evicted_tile_id = lru_list.back();
+		lru_list.pop_back();
+		auto evicted_it = tiles.find(evicted_tile_id);
+		content = std::move(evicted_it->second.content);
+		tiles.erase(evicted_it);
+	}
+	content.resize(TILE_DIM*TILE_DIM*4);
+
+	assert(tile_generator);
+	tile_generator(tile_id / tiles_x_cnt, tile_id % tiles_x_cnt,
+			content.data());
+	++generated_tiles_cnt;
+
+	lru_list.push_front(tile_id);
+	tile_t &tile = tiles[tile_id];
+	tile.content = std::move(content);
+	tile.lru_it = lru_list.begin();
+	return tile.content.data();
+}
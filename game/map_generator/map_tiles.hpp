@@ -0,0 +1,95 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef MAP_TILES_HPP
+#define MAP_TILES_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <useful.hpp>
+
+// CPU map storage divided into square tiles. A tile is generated on
+// the first access and kept until it becomes the least recently used
+// one while the cache is full. Pixels have the same layout as in
+// map_storage_t, but only the not tripled map is addressed.
+struct map_tiles_t {
+	static constexpr int TILE_DIM = 128;
+	// Has to fill TILE_DIM*TILE_DIM*4 bytes of `content`
+	using tile_generator_t
+		= std::function<void(int tile_y, int tile_x, uint8_t *content)>;
+
+	// Basic usage functions
+	map_tiles_t() = default;
+	void load_settings();
+	void set_tile_generator(tile_generator_t tile_generator);
+	void clear();
+
+	// Getters
+	inline int get_width() const;
+	inline int get_height() const;
+	inline std::size_t get_cached_tiles_cnt() const;
+	inline std::size_t get_generated_tiles_cnt() const;
+	inline uint8_t get_component_value(int y, int x, int component);
+
+private:
+	struct tile_t {
+		std::vector<uint8_t> content;
+		// Position in `lru_list`
+		std::list<std::size_t>::iterator lru_it;
+	};
+
+	const uint8_t* get_tile_content(std::size_t tile_id);
+
+	int width = 0;
+	int height = 0;
+	int tiles_x_cnt = 0;
+	int tiles_y_cnt = 0;
+	std::size_t max_cached_tiles_cnt = 1;
+	std::size_t generated_tiles_cnt = 0;
+	tile_generator_t tile_generator;
+
+	std::unordered_map<std::size_t, tile_t> tiles;
+	// Tiles' ids, the most recently used at the front
+	std::list<std::size_t> lru_list;
+	// Consecutive accesses usually hit the same tile
+	std::size_t last_tile_id = INVALID_ID;
+	const uint8_t *last_tile_content = nullptr;
+};
+
+inline int map_tiles_t::get_width() const {
+	return width;
+}
+
+inline int map_tiles_t::get_height() const {
+	return height;
+}
+
+inline std::size_t map_tiles_t::get_cached_tiles_cnt() const {
+	return tiles.size();
+}
+
+inline std::size_t map_tiles_t::get_generated_tiles_cnt() const {
+	return generated_tiles_cnt;
+}
+
+inline uint8_t map_tiles_t::get_component_value(
+		int y, int x, int component) {
+	assert(0 <= y && y < height);
+	assert(0 <= x && x < width);
+	const std::size_t tile_id
+		= static_cast<std::size_t>(y / TILE_DIM) * tiles_x_cnt + x / TILE_DIM;
+	if (tile_id != last_tile_id) {
+		last_tile_content = get_tile_content(tile_id);
+		last_tile_id = tile_id;
+	}
+	return last_tile_content[
+		(y % TILE_DIM)*TILE_DIM*4 + (x % TILE_DIM)*4 + component];
+}
+
+#endif
@@ -8,6 +8,28 @@
 
 using namespace glm;
 
+std::size_t append_cyclic_copies(
+		std::vector<double> &coords, const std::size_t points_cnt,
+		const double beg_x, const double period, const double band,
+		std::vector<std::size_t> &copies_source) {
+	for (std::size_t i = 0; i < points_cnt; ++i) {
+		if (coords[2*i+0] > beg_x + period - band) {
+			coords.push_back(coords[2*i+0] - period);
+			coords.push_back(coords[2*i+1]);
+			copies_source.push_back(i);
+		}
+	}
+	const std::size_t left_copies_cnt = copies_source.size();
+	for (std::size_t i = 0; i < points_cnt; ++i) {
+		if (coords[2*i+0] < beg_x + band) {
+			coords.push_back(coords[2*i+0] + period);
+			coords.push_back(coords[2*i+1]);
+			copies_source.push_back(i);
+		}
+	}
+	return left_copies_cnt;
+}
+
 glm::dvec2 voronoi_diagram_t::triangle_circumcenter(
 		glm::dvec2 A, glm::dvec2 B, glm::dvec2 C) const {
 
@@ -386,8 +408,16 @@ void voronoi_t::edge_t::correct_quad() {
 void voronoi_diagram_t::generate() {
 	const delaunator::Delaunator d(centers);
 	half_edge_drawn.resize(d.halfedges.size());
-	voronois.assign(voronois_cnt(), voronoi_t());
+	// Polygons are reset without releasing their buffers,
+	// so that relaxation iterations can reuse them
+	for (voronoi_t &voronoi : voronois) {
+		voronoi.points.clear();
+		voronoi.al.clear();
+		voronoi.clipped = false;
+		voronoi.completed = false;
+	}
 	std::vector<dvec2> tri_circumcenter(d.triangles.size() / 3);
+	#pragma omp parallel for schedule (static)
 	for (std::size_t i = 0; i < d.triangles.size() / 3; ++i) {
 		dvec2 A, B, C;
 		A.x = d.coords[2 * d.triangles[3*i]];
@@ -400,34 +430,43 @@ void voronoi_diagram_t::generate() {
 		tri_circumcenter[i] = triangle_circumcenter(A, B, C);
 	}
 
-	// Iterate over all half edges
+	// There are many half edges starting in a voronoi
+	// center, but only the first one of them is needed,
+	// the polygon construction iterates over the others.
+	std::vector<std::size_t> first_half_edge(voronois_cnt(), INVALID_ID);
 	for (std::size_t i = 0; i < d.triangles.size(); ++i) {
 		const std::size_t center_id = d.triangles[i];
 		const bool voronoi_is_duplicate = center_id >= voronois_cnt();
 		if (voronoi_is_duplicate)
 			continue;
-		// const std::size_t voronoi_id
-		// 	= center_id < voronois_cnt()
-		// 	? center_id : center_id - voronois_cnt();
-		const std::size_t voronoi_id = center_id;
-		voronoi_t &voronoi = voronois[voronoi_id];
+		if (first_half_edge[center_id] == INVALID_ID)
+			first_half_edge[center_id] = i;
+	}
 
-		// There are many half edges starting in a voronoi
-		// center, but this loop finds only one of them
-		// and then iterates over the others.
-		if (voronoi.completed)
+	// Polygons are independent of each other, so they are built in parallel
+	#pragma omp parallel
+	{
+	// Half edges' indices from Delaunay triangulation
+	// equivalent to the voronoi's edges
+	std::vector<std::size_t> tri_half_edges;
+	std::vector<reduced_edge_t> red_edges;
+
+	#pragma omp for schedule (dynamic, 32)
+	for (std::size_t voronoi_id = 0;
+			voronoi_id < voronois_cnt(); ++voronoi_id) {
+		if (first_half_edge[voronoi_id] == INVALID_ID)
 			continue;
+		const std::size_t center_id = voronoi_id;
+		voronoi_t &voronoi = voronois[voronoi_id];
 		voronoi.completed = true;
-
-		// Half edges' indices from Delaunay triangulation
-		// equivalent to the voronoi's edges
-		std::vector<std::size_t> tri_half_edges;
+		tri_half_edges.clear();
+		red_edges.clear();
 
 		// Finding the triangle (if such exists)
 		// that is adjacent to void that is also
 		// the most counterclockwise rotated about
 		// the voronoi center.
-		const std::size_t start_half_edge = i;
+		const std::size_t start_half_edge = first_half_edge[voronoi_id];
 		std::size_t beg_half_edge = start_half_edge;
 		do {
 			const std::size_t next_half_edge_in_triangle
@@ -489,12 +528,13 @@ void voronoi_diagram_t::generate() {
 			edge.quad_bottom.x = d.coords[2*edge.neighbor_id+0];
 			edge.quad_bottom.y = d.coords[2*edge.neighbor_id+1];
 
-			if (edge.neighbor_id >= 2*voronois_cnt()) {
-				edge.type = voronoi_t::edge_t::TO_RIGHT;
-				edge.neighbor_id -= 2*voronois_cnt();
-			} else if (edge.neighbor_id >= 1*voronois_cnt()) {
-				edge.type = voronoi_t::edge_t::TO_LEFT;
-				edge.neighbor_id -= 1*voronois_cnt();
+			if (edge.neighbor_id >= voronois_cnt()) {
+				const std::size_t duplicate_id
+					= edge.neighbor_id - voronois_cnt();
+				edge.type = duplicate_id < left_duplicates_cnt ?
+					voronoi_t::edge_t::TO_LEFT :
+					voronoi_t::edge_t::TO_RIGHT;
+				edge.neighbor_id = duplicates_source[duplicate_id];
 			} else {
 				edge.type = voronoi_t::edge_t::USUAL;
 			}
@@ -504,7 +544,6 @@ void voronoi_diagram_t::generate() {
 		// to voronoi diagram edges, clipping them
 		// and ignoring them if they don't exist
 		// on the visible plane.
-		std::vector<reduced_edge_t> red_edges;
 		std::size_t last_incoming_red_edge_id = INVALID_ID;
 		for (std::size_t j = 0; j < tri_half_edges.size(); ++j) {
 			const std::size_t h = tri_half_edges[j];
@@ -633,48 +672,54 @@ void voronoi_diagram_t::generate() {
 				voronoi.points.push_back(e.beg);
 		}
 	}
+	}
 }
 
-void voronoi_diagram_t::voronoi_iteration() {
+double voronoi_diagram_t::voronoi_iteration() {
 	const std::size_t cnt = voronois_cnt();
-	for (std::size_t i = 0; i < voronois_cnt(); ++i) {
+	double max_shift_sq = 0.0;
+	#pragma omp parallel for schedule (static) reduction (max : max_shift_sq)
+	for (std::size_t i = 0; i < cnt; ++i) {
 		dvec2 new_center(0);
 		for (const dvec2 &p : voronois[i].points)
 			new_center += p;
 		new_center /= static_cast<double>(voronois[i].points.size());
+		max_replace(max_shift_sq,
+				len_sq(new_center - dvec2(centers[2*i+0], centers[2*i+1])));
 		centers[2*i+0] = new_center.x;
 		centers[2*i+1] = new_center.y;
-		centers[2*(cnt*1+i) + 0]
-			= new_center.x - space_max_x_duplicate_off;
-		centers[2*(cnt*1+i) + 1] = new_center.y;
-		centers[2*(cnt*2+i) + 0]
-			= new_center.x + space_max_x_duplicate_off;
-		centers[2*(cnt*2+i) + 1] = new_center.y;
-
-		// Previous calculations are not valid anymore
-		voronois[i] = voronoi_t();
 	}
+	duplicate_centers();
 	half_edge_drawn.clear();
+	return std::sqrt(max_shift_sq);
+}
+
+void voronoi_diagram_t::duplicate_centers() {
+	const std::size_t cnt = voronois_cnt();
+	centers.resize(cnt*2);
+	duplicates_source.clear();
+	left_duplicates_cnt = append_cyclic_copies(
+			centers, cnt,
+			space_max_x_duplicate_off, space_max_x_duplicate_off,
+			cyclic_band, duplicates_source);
 }
 
-void voronoi_diagram_t::generate_relaxed(std::size_t iterations_cnt) {
+void voronoi_diagram_t::generate_relaxed(
+		std::size_t iterations_cnt, double convergence_eps) {
 	const std::size_t cnt = voronois_cnt();
-	centers.resize(cnt*2 *3);
+	centers.resize(cnt*2);
 	for (std::size_t i = 0; i < cnt; ++i) {
 		centers[2*i+0] = voronois[i].center.x;
 		centers[2*i+1] = voronois[i].center.y;
-		centers[2*(cnt*1+i) + 0]
-			= voronois[i].center.x - space_max_x_duplicate_off;
-		centers[2*(cnt*1+i) + 1] = voronois[i].center.y;
-		centers[2*(cnt*2+i) + 0]
-			= voronois[i].center.x + space_max_x_duplicate_off;
-		centers[2*(cnt*2+i) + 1] = voronois[i].center.y;
 	}
+	duplicate_centers();
 
 	generate();
 	for (std::size_t iteration = 0; iteration < iterations_cnt; ++iteration) {
-		voronoi_iteration();
+		const double max_shift = voronoi_iteration();
 		generate();
+		if (max_shift < convergence_eps)
+			break;
 	}
 
 	for (std::size_t i = 0; i < cnt; ++i) {
@@ -6,8 +6,22 @@
 #define VORONOI_HPP
 
 #include <vector>
+#include <limits>
 #include <glm/glm.hpp>
 
+// Points of a cylinder with the x axis wrapped to [beg_x, beg_x+period) are
+// triangulated as a plane, with points near the border copied to the other
+// side. Appends copies shifted by -period of points lying within `band`
+// of the right border, followed by copies shifted by +period of points
+// lying within `band` of the left border. With an infinite band all points
+// are copied, which is exact, narrower bands suffice for evenly spread
+// points. Ids of copied points are appended to `copies_source`.
+// Returns the number of the copies shifted to the left.
+std::size_t append_cyclic_copies(
+		std::vector<double> &coords, std::size_t points_cnt,
+		double beg_x, double period, double band,
+		std::vector<std::size_t> &copies_source);
+
 struct voronoi_diagram_t;
 struct voronoi_t {
 	glm::dvec2 center;
@@ -79,6 +93,9 @@ struct voronoi_diagram_t {
 	double space_max_x_duplicate_off;
 	// Equal to `glm::dvec2(space_max_x_duplicate_off, 0.0)`
 	glm::dvec2 duplicate_off_vec;
+	// Only centers this close to the middle one third's border are
+	// duplicated, see append_cyclic_copies
+	double cyclic_band = std::numeric_limits<double>::infinity();
 	// Will contain computed voronoi diagram.
 	std::vector<voronoi_t> voronois;
 
@@ -87,17 +104,24 @@ struct voronoi_diagram_t {
 	std::vector<bool> half_edge_drawn;
 
 	inline std::size_t voronois_cnt();
-	void generate_relaxed(std::size_t iterations_cnt);
+	// Stops earlier if no center has moved by at least
+	// `convergence_eps` in the last iteration
+	void generate_relaxed(std::size_t iterations_cnt,
+			double convergence_eps = 0.0);
 
 private:
+	// Centers of the polygons followed by their duplicates
 	std::vector<double> centers;
+	std::vector<std::size_t> duplicates_source;
+	std::size_t left_duplicates_cnt;
+	void duplicate_centers();
 	void generate();
 	// Applies Lloyd's relaxation algorithm
 	// Calculations are based on the `voronois`
-	// array. After calculating new voronoi centers
-	// it restores default voronoi polygons state
-	// without clearing `voronois` array.
-	void voronoi_iteration();
+	// array. Polygons become invalid until the
+	// next `generate` call.
+	// Returns the greatest distance a center has moved.
+	double voronoi_iteration();
 
 	enum class inters_t : uint8_t {
 		// Clockwise sides order
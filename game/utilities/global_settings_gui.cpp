@@ -110,7 +110,37 @@ void global_settings_gui::draw_general_settings() {
 			ImGui::Checkbox("triple_map_size",
 				&global_settings.triple_map_size);
 		else
-			global_settings.triple_map_size = true;
+			global_settings.triple_map_size = not global_settings.cyclic_map;
+
+		if (global_settings.generate_with_gpu)
+			ImGui::Checkbox("emulate_gpu_on_cpu",
+				&global_settings.emulate_gpu_on_cpu);
+
+		if (not global_settings.generate_with_gpu) {
+			ImGui::Checkbox("cyclic_map",
+				&global_settings.cyclic_map);
+
+			ImGui::Checkbox("stream_map_tiles",
+				&global_settings.stream_map_tiles);
+
+			ImGui::DragScalar("max_cached_map_tiles", ImGuiDataType_U64,
+				&global_settings.max_cached_map_tiles,
+				1.0f,
+				&global_settings.max_cached_map_tiles_min,
+				&global_settings.max_cached_map_tiles_max);
+
+			ImGui::Checkbox("use_map_cache",
+				&global_settings.use_map_cache);
+
+			ImGui::DragScalar("map_cache_max_size_mb", ImGuiDataType_U64,
+				&global_settings.map_cache_max_size_mb,
+				1.0f,
+				&global_settings.map_cache_max_size_mb_min,
+				&global_settings.map_cache_max_size_mb_max);
+
+			ImGui::Checkbox("progressive_map_generation",
+				&global_settings.progressive_map_generation);
+		}
 
 		ImGui::DragScalar("voro_cnt", ImGuiDataType_U64,
 			&global_settings.voro_cnt,
@@ -41,6 +41,13 @@ void settings_t::save_settings_to_file() {
 
 	WRITE_FIELD( generate_with_gpu )
 	WRITE_FIELD( triple_map_size )
+	WRITE_FIELD( cyclic_map )
+	WRITE_FIELD( emulate_gpu_on_cpu )
+	WRITE_FIELD( stream_map_tiles )
+	WRITE_FIELD( max_cached_map_tiles )
+	WRITE_FIELD( use_map_cache )
+	WRITE_FIELD( map_cache_max_size_mb )
+	WRITE_FIELD( progressive_map_generation )
     file << '\n';
 
 	WRITE_FIELD( replace_seed )
@@ -109,6 +116,13 @@ void settings_t::load_settings_from_file(const char * const path) {
 
         READ_FIELD( generate_with_gpu )
         READ_FIELD( triple_map_size )
+        READ_FIELD( cyclic_map )
+        READ_FIELD( emulate_gpu_on_cpu )
+        READ_FIELD( stream_map_tiles )
+        READ_FIELD( max_cached_map_tiles )
+        READ_FIELD( use_map_cache )
+        READ_FIELD( map_cache_max_size_mb )
+        READ_FIELD( progressive_map_generation )
 
         READ_FIELD( replace_seed )
         READ_FIELD( voro_cnt       )
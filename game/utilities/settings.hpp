@@ -27,6 +27,8 @@
 #define SHADER_LINE_VERTEX_PATH "runtime/shader_line_vertex.glsl"
 #define SHADER_LINE_FRAGMENT_PATH "runtime/shader_line_fragment.glsl"
 
+#define MAP_CACHE_DIR_PATH "runtime/map_cache"
+
 #define SHADER_MAP_GENERATOR_COMPUTE_PATH \
 	"runtime/shader_map_generator_compute.glsl"
 
@@ -66,6 +68,15 @@ extern struct settings_t {
     // Map rendering
 	FIELD(bool       , generate_with_gpu            , true,     0,    1)
 	FIELD(bool       , triple_map_size              , false,    0,    1)
+	FIELD(bool       , cyclic_map                   , false,    0,    1)
+	FIELD(bool       , emulate_gpu_on_cpu           , false,    0,    1)
+	FIELD(bool       , stream_map_tiles             , false,    0,    1)
+	FIELD(std::size_t, max_cached_map_tiles         , 256,      1,    1'000'000)
+	FIELD(bool       , use_map_cache                , true,     0,    1)
+	FIELD(std::size_t, map_cache_max_size_mb        , 512,      1,    1'000'000)
+	// Coarse previews of CPU maps. The finest one is reused by the final
+	// pass, still the whole map takes about 10-15% longer.
+	FIELD(bool       , progressive_map_generation   , true,     0,    1)
 
     // Map shape
 	FIELD(std::size_t, replace_seed                 , 0,        0,    ULLONG_MAX)
@@ -0,0 +1,243 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#include "task_graph.hpp"
+
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+std::size_t task_graph_t::add_task(
+		const char *name,
+		const std::vector<std::size_t> &dependencies,
+		task_function_t function,
+		inputs_hash_function_t inputs_hash,
+		bool runs_own_threads) {
+	const std::size_t task_id = tasks.size();
+	for (const std::size_t dependency : dependencies) {
+		assert(dependency < task_id);
+		tasks[dependency].dependents.push_back(task_id);
+	}
+	tasks.push_back({
+		name,
+		dependencies,
+		{},
+		std::move(function),
+		std::move(inputs_hash),
+		runs_own_threads,
+	});
+	return task_id;
+}
+
+task_graph_t::~task_graph_t() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	state_changed.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+void task_graph_t::invalidate_all() {
+	for (task_t &task : tasks)
+		task.valid = false;
+}
+
+std::size_t task_graph_t::run(std::size_t threads_cnt) {
+	return run_selected(std::vector<bool>(tasks.size(), true), threads_cnt);
+}
+
+std::size_t task_graph_t::run_up_to(
+		std::size_t task_id, std::size_t threads_cnt) {
+	assert(task_id < get_tasks_cnt());
+	std::vector<bool> selected(tasks.size(), false);
+	selected[task_id] = true;
+	// Dependencies always precede their dependents
+	for (std::size_t i = task_id+1; i-- > 0; ) {
+		if (not selected[i])
+			continue;
+		for (const std::size_t dependency : tasks[i].dependencies)
+			selected[dependency] = true;
+	}
+	return run_selected(selected, threads_cnt);
+}
+
+bool task_graph_t::is_outdated(std::size_t task_id) const {
+	assert(task_id < get_tasks_cnt());
+	const task_t &task = tasks[task_id];
+	if (not task.valid)
+		return true;
+	if ((task.inputs_hash ? task.inputs_hash() : 0) != task.last_inputs_hash)
+		return true;
+	for (const std::size_t dependency : task.dependencies)
+		if (is_outdated(dependency))
+			return true;
+	return false;
+}
+
+std::size_t task_graph_t::run_selected(
+		const std::vector<bool> &selected, std::size_t threads_cnt) {
+	std::unique_lock<std::mutex> lock(mutex);
+	run_start = std::chrono::high_resolution_clock::now();
+	last_run_cancelled = false;
+	this->selected = selected;
+
+	// Tasks are stored in a topological order, so dependencies are
+	// resolved before their dependents
+	ready.clear();
+	outdated_cnt = 0;
+	for (task_t &task : tasks) {
+		if (not selected[&task - tasks.data()]) {
+			task.run_in_last_run = false;
+			task.start = 0.0;
+			task.duration = 0.0;
+			continue;
+		}
+
+		const std::size_t inputs_hash
+			= task.inputs_hash ? task.inputs_hash() : 0;
+		task.run_in_last_run = not task.valid
+			or inputs_hash != task.last_inputs_hash;
+		task.last_inputs_hash = inputs_hash;
+		task.pending_dependencies_cnt = 0;
+		for (const std::size_t dependency : task.dependencies)
+			if (tasks[dependency].run_in_last_run)
+				++task.pending_dependencies_cnt;
+		if (task.pending_dependencies_cnt > 0)
+			task.run_in_last_run = true;
+
+		if (not task.run_in_last_run) {
+			task.start = 0.0;
+			task.duration = 0.0;
+			continue;
+		}
+		task.valid = false;
+		++outdated_cnt;
+		if (task.pending_dependencies_cnt == 0)
+			ready.push_back(&task - tasks.data());
+	}
+
+	if (outdated_cnt == 0) {
+		last_run_duration = 0.0;
+		return 0;
+	}
+
+	// The calling thread is one of the workers
+	threads_cnt = std::clamp<std::size_t>(threads_cnt, 1, outdated_cnt);
+	while (workers.size() < threads_cnt-1)
+		workers.emplace_back(&task_graph_t::work, this);
+	finished_cnt = 0;
+	own_threads_task_running = false;
+#ifdef _OPENMP
+	omp_threads_cnt = omp_get_max_threads();
+#endif
+	run_workers_cnt = threads_cnt-1;
+	joined_workers_cnt = 0;
+	run_open = true;
+	state_changed.notify_all();
+
+	execute_tasks(lock);
+#ifdef _OPENMP
+	omp_set_num_threads(omp_threads_cnt);
+#endif
+	// Joined workers may still be leaving the run
+	state_changed.wait(lock, [this] () {
+		return active_workers_cnt == 0;
+	});
+	run_open = false;
+
+	last_run_duration = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - run_start).count();
+	return outdated_cnt;
+}
+
+void task_graph_t::execute_tasks(std::unique_lock<std::mutex> &lock) {
+	++active_workers_cnt;
+	// Position in `ready` of the last task allowed to start, or ready.size()
+	const auto find_startable = [this] () {
+		for (std::size_t i = ready.size(); i-- > 0; )
+			if (not own_threads_task_running
+					or not tasks[ready[i]].runs_own_threads)
+				return i;
+		return ready.size();
+	};
+	while (true) {
+		std::size_t ready_pos;
+		state_changed.wait(lock, [&] () {
+			ready_pos = find_startable();
+			return ready_pos != ready.size()
+				or finished_cnt == outdated_cnt;
+		});
+		if (finished_cnt == outdated_cnt)
+			break;
+		const std::size_t task_id = ready[ready_pos];
+		ready.erase(ready.begin() + ready_pos);
+		task_t &task = tasks[task_id];
+
+		// Cancelled tasks are finished without being executed, so that
+		// their dependents are released and skipped as well
+		if (cancel_flag and cancel_flag->load()) {
+			last_run_cancelled = true;
+			task.start = 0.0;
+			task.duration = 0.0;
+		} else {
+			if (task.runs_own_threads)
+				own_threads_task_running = true;
+#ifdef _OPENMP
+			omp_set_num_threads(task.runs_own_threads ? omp_threads_cnt : 1);
+#endif
+			lock.unlock();
+			const auto task_start
+				= std::chrono::high_resolution_clock::now();
+			task.function();
+			const auto task_end
+				= std::chrono::high_resolution_clock::now();
+			lock.lock();
+			if (task.runs_own_threads)
+				own_threads_task_running = false;
+
+			task.start = std::chrono::duration<double, std::milli>(
+					task_start - run_start).count();
+			task.duration = std::chrono::duration<double, std::milli>(
+					task_end - task_start).count();
+			task.valid = true;
+		}
+		++finished_cnt;
+		for (const std::size_t dependent : task.dependents) {
+			if (not selected[dependent])
+				tasks[dependent].valid = false;
+			else if (--tasks[dependent].pending_dependencies_cnt == 0)
+				ready.push_back(dependent);
+		}
+		state_changed.notify_all();
+	}
+	--active_workers_cnt;
+	state_changed.notify_all();
+}
+
+void task_graph_t::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		state_changed.wait(lock, [this] () {
+			return quitting
+				or (run_open and joined_workers_cnt < run_workers_cnt);
+		});
+		if (quitting)
+			return;
+		++joined_workers_cnt;
+		execute_tasks(lock);
+	}
+}
+
+void task_graph_t::print_last_run_durations() const {
+	for (const task_t &task : tasks) {
+		if (task.run_in_last_run)
+			printf("%s: %.1f ms, from %.1f ms\n",
+					task.name, task.duration, task.start);
+		else
+			printf("%s: skipped\n", task.name);
+	}
+	printf("total: %.1f ms\n", last_run_duration);
+}
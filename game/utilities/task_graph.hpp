@@ -0,0 +1,168 @@
+// Copyright (C) 2024, Kacper Orszulak
+// GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
+
+#pragma once
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <useful.hpp>
+
+// Dependency graph of tasks executed by a pool of threads. The pool's
+// threads are started by the first run needing them and persist until
+// the graph is destroyed, the calling thread takes part in every run.
+// A task starts as
+// soon as all of its dependencies have finished, so independent tasks
+// overlap. Tasks running their own threads get all OpenMP threads and are
+// executed one at a time. Parallel regions of the other tasks are serial,
+// so that they overlap with the former without oversubscribing the CPU.
+// A run executes only outdated tasks: the ones which never ran, whose own
+// inputs changed, or which depend on an executed task.
+class task_graph_t {
+public:
+	typedef std::function<void()> task_function_t;
+	// Returns a hash of the task's inputs not produced by its dependencies
+	typedef std::function<std::size_t()> inputs_hash_function_t;
+
+	task_graph_t() = default;
+	task_graph_t(const task_graph_t&) = delete;
+	task_graph_t& operator=(const task_graph_t&) = delete;
+	~task_graph_t();
+
+	// Dependencies have to be added before the task, returns the task's id
+	std::size_t add_task(
+			const char *name,
+			const std::vector<std::size_t> &dependencies,
+			task_function_t function,
+			inputs_hash_function_t inputs_hash = nullptr,
+			bool runs_own_threads = false);
+	void invalidate_all();
+	// Returns the number of executed tasks
+	std::size_t run(
+			std::size_t threads_cnt = std::thread::hardware_concurrency());
+	// Same as above, but only for the task and its (indirect) dependencies.
+	// Skipped dependents of executed tasks become outdated.
+	std::size_t run_up_to(std::size_t task_id,
+			std::size_t threads_cnt = std::thread::hardware_concurrency());
+	// Whether the next run would execute the task
+	bool is_outdated(std::size_t task_id) const;
+	// Once the flag is set, runs start no more tasks. Tasks which have not
+	// started stay outdated.
+	inline void set_cancel_flag(const std::atomic<bool> *cancel_flag);
+	// Whether the last run has been cancelled before finishing all tasks
+	inline bool was_last_run_cancelled() const;
+	void print_last_run_durations() const;
+
+	inline std::size_t get_tasks_cnt() const;
+	inline const char* get_task_name(std::size_t task_id) const;
+	inline bool has_task_run_in_last_run(std::size_t task_id) const;
+	// Durations are given in milliseconds
+	inline double get_task_duration(std::size_t task_id) const;
+	inline double get_last_run_duration() const;
+
+	// Combines hashes of all arguments, for inputs hash functions
+	template<class... Ts>
+	static inline std::size_t hash_inputs(const Ts&... inputs);
+
+private:
+	// Runs outdated tasks among the selected ones, selected tasks' dependencies
+	// have to be selected as well
+	std::size_t run_selected(const std::vector<bool> &selected,
+			std::size_t threads_cnt);
+	// Executes ready tasks of the current run until all of them have
+	// finished, the lock is held outside of the tasks
+	void execute_tasks(std::unique_lock<std::mutex> &lock);
+	// Body of the pool's threads, joins runs which allow more threads
+	void work();
+
+	struct task_t {
+		const char *name;
+		std::vector<std::size_t> dependencies;
+		std::vector<std::size_t> dependents;
+		task_function_t function;
+		inputs_hash_function_t inputs_hash;
+		bool runs_own_threads;
+		std::size_t last_inputs_hash = 0;
+		bool valid = false;
+		bool run_in_last_run = false;
+		// Since the start of the run
+		double start = 0.0;
+		double duration = 0.0;
+		// Outdated dependencies left to finish in the current run
+		std::size_t pending_dependencies_cnt = 0;
+	};
+
+	std::vector<task_t> tasks;
+	double last_run_duration = 0.0;
+	const std::atomic<bool> *cancel_flag = nullptr;
+	bool last_run_cancelled = false;
+
+	// The pool and the state of the current run, guarded by the mutex
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable state_changed;
+	bool quitting = false;
+	bool run_open = false;
+	// Pool threads allowed to join the current run and the ones which did
+	std::size_t run_workers_cnt = 0;
+	std::size_t joined_workers_cnt = 0;
+	// Threads executing tasks of the current run, with the calling one
+	std::size_t active_workers_cnt = 0;
+	std::vector<bool> selected;
+	std::vector<std::size_t> ready;
+	std::size_t outdated_cnt = 0;
+	std::size_t finished_cnt = 0;
+	bool own_threads_task_running = false;
+	// OpenMP threads of the calling thread, given to tasks running their
+	// own threads
+	int omp_threads_cnt = 1;
+	std::chrono::high_resolution_clock::time_point run_start;
+};
+
+inline std::size_t task_graph_t::get_tasks_cnt() const {
+	return tasks.size();
+}
+
+inline const char* task_graph_t::get_task_name(std::size_t task_id) const {
+	assert(task_id < get_tasks_cnt());
+	return tasks[task_id].name;
+}
+
+inline bool task_graph_t::has_task_run_in_last_run(std::size_t task_id) const {
+	assert(task_id < get_tasks_cnt());
+	return tasks[task_id].run_in_last_run;
+}
+
+inline double task_graph_t::get_task_duration(std::size_t task_id) const {
+	assert(task_id < get_tasks_cnt());
+	return tasks[task_id].duration;
+}
+
+inline double task_graph_t::get_last_run_duration() const {
+	return last_run_duration;
+}
+
+inline void task_graph_t::set_cancel_flag(
+		const std::atomic<bool> *cancel_flag) {
+	this->cancel_flag = cancel_flag;
+}
+
+inline bool task_graph_t::was_last_run_cancelled() const {
+	return last_run_cancelled;
+}
+
+template<class... Ts>
+inline std::size_t task_graph_t::hash_inputs(const Ts&... inputs) {
+	std::size_t seed = 0;
+	((seed ^= std::hash<Ts>{}(inputs) + 0x9e3779b9 + (seed << 6) + (seed >> 2)),
+	 ...);
+	return seed;
+}
+
+#endif
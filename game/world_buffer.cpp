@@ -4,43 +4,205 @@
 #include "world_buffer.hpp"
 #include "settings.hpp"
 
+#include <limits>
+#include <algorithm>
+
 void world_buffer_t::load_settings() {
     width = global_settings.map_width_in_units * global_settings.map_unit_resolution / chunk_t::WIDTH;
     height = 1;
     depth = global_settings.map_height_in_units * global_settings.map_unit_resolution / chunk_t::DEPTH;
 }
 
-bool world_buffer_t::collision_check_XY_rect(
-		glm::vec3 pos, glm::vec2 dimensions) {
-	const glm::vec2 pos_end(pos.x+dimensions.x, pos.y+dimensions.y);
-
-	glm::vec2 iterations_cnt(
-			std::ceil(dimensions.x)+1,
-			std::ceil(dimensions.y)+1
-		);
-	if (pos_end.x == std::floor(pos_end.x))
-		iterations_cnt.x -= 1;
-	if (pos_end.y == std::floor(pos_end.y))
-		iterations_cnt.y -= 1;
-
-	for (float dx = 0, j = 0; j < iterations_cnt.x; j += 1) {
-		for (float dy = 0, i = 0; i < iterations_cnt.y; i += 1) {
-			const glm::ivec3 wanted_block_pos(
-					std::floor(pos.x+dx),
-					std::floor(pos.y+dy),
-					std::floor(pos.z)
-				);
-			if (get(wanted_block_pos) != block_type::none)
-				return true;
-
-			dy += 1;
-			if (dy > dimensions.y)
-				dy = dimensions.y;
+glm::bvec2 world_buffer_t::move_XY_rect(glm::vec3 &pos,
+		glm::vec2 dimensions, glm::vec2 offset) const {
+	glm::bvec2 has_collided(false, false);
+	const int z = std::floor(pos.z);
+
+	// Leading edge of the rectangle along an axis
+	const auto get_lead = [&pos, &dimensions, &offset] (int axis) {
+		return offset[axis] > 0 ? pos[axis] + dimensions[axis] : pos[axis];
+	};
+	// Grid line the leading edge crosses next, the rectangle enters
+	// the blocks' row or column right behind it
+	glm::ivec2 next_line;
+	for (int axis = 0; axis < 2; ++axis)
+		next_line[axis] = offset[axis] > 0 ?
+			std::ceil(get_lead(axis)) : std::floor(get_lead(axis));
+
+	// Whether the blocks entered when the leading edge of the axis
+	// reaches the next line are free
+	const auto is_entered_line_free = [this, &pos, &dimensions, &offset,
+			&next_line, z] (int axis) {
+		const int other = 1 - axis;
+		const int entered = offset[axis] > 0 ?
+			next_line[axis] : next_line[axis] - 1;
+		const int beg = std::floor(pos[other]);
+		const int end = std::ceil(pos[other] + dimensions[other]);
+		for (int i = beg; i < end; ++i) {
+			glm::ivec3 block_pos(0, 0, z);
+			block_pos[axis] = entered;
+			block_pos[other] = i;
+			if (get_if_exists(block_pos) != block_type::none)
+				return false;
+		}
+		return true;
+	};
+
+	// Lines are crossed in the order of time, as a fraction of the offset.
+	// On ties x goes first. Reaching a line at the very end of the move
+	// does not enter the blocks behind it.
+	float time = 0.0f;
+	while (offset != glm::vec2(0, 0)) {
+		int axis = -1;
+		float axis_time = 1.0f;
+		for (int a = 0; a < 2; ++a) {
+			if (offset[a] == 0)
+				continue;
+			const float a_time
+				= time + (next_line[a] - get_lead(a)) / offset[a];
+			if (a_time < axis_time) {
+				axis = a;
+				axis_time = a_time;
+			}
+		}
+
+		if (axis == -1) {
+			pos.x += offset.x * (1.0f - time);
+			pos.y += offset.y * (1.0f - time);
+			break;
+		}
+
+		// The crossing axis is snapped exactly onto the line
+		const int other = 1 - axis;
+		pos[other] += offset[other] * (axis_time - time);
+		pos[axis] = offset[axis] > 0 ?
+			next_line[axis] - dimensions[axis] : next_line[axis];
+		time = axis_time;
+
+		if (is_entered_line_free(axis)) {
+			next_line[axis] += offset[axis] > 0 ? 1 : -1;
+		} else {
+			has_collided[axis] = true;
+			offset[axis] = 0;
+		}
+	}
+	return has_collided;
+}
+
+world_buffer_t::raycast_hit_t world_buffer_t::raycast(glm::vec3 origin,
+		glm::vec3 direction, float max_distance) const {
+	constexpr int WIDTH = chunk_t::WIDTH;
+	constexpr int HEIGHT = chunk_t::HEIGHT;
+	constexpr int DEPTH = chunk_t::DEPTH;
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	raycast_hit_t hit;
+	direction = glm::normalize(direction);
+
+	// Amanatides-Woo traversal: `t_max` holds distances along the ray to
+	// the next grid lines crossed along each axis
+	glm::ivec3 cell(
+		std::floor(origin.x), std::floor(origin.y), std::floor(origin.z));
+	glm::ivec3 step;
+	glm::vec3 t_delta;
+	glm::vec3 t_max;
+	for (int axis = 0; axis < 3; ++axis) {
+		step[axis] = direction[axis] > 0 ? 1 : direction[axis] < 0 ? -1 : 0;
+		t_delta[axis] = step[axis] != 0 ? std::abs(1.0f / direction[axis]) : INF;
+	}
+	const auto get_line_distance = [&origin, &direction, &step] (
+			int axis, int line) {
+		return step[axis] != 0 ? (line - origin[axis]) / direction[axis] : INF;
+	};
+	const auto reset_t_max = [&] () {
+		for (int axis = 0; axis < 3; ++axis)
+			t_max[axis] = get_line_distance(axis,
+					cell[axis] + (step[axis] > 0 ? 1 : 0));
+	};
+	reset_t_max();
+
+	float t = 0.0f;
+	glm::ivec3 normal(0);
+	glm::ivec2 chunk_pos;
+	const chunk_t *chunk = nullptr;
+	bool chunk_valid = false;
+	while (t <= max_distance) {
+		// Rays leaving the world never come back
+		if ((cell.y >= HEIGHT and step.y >= 0) or (cell.y < 0 and step.y <= 0)
+				or (cell.z < 0 and step.z <= 0)
+				or (cell.z >= get_world_depth() and step.z >= 0))
+			break;
+
+		const glm::ivec2 cell_chunk_pos(
+			floor_div(cell.x, WIDTH), floor_div(cell.z, DEPTH));
+		if (not chunk_valid or cell_chunk_pos != chunk_pos) {
+			chunk_pos = cell_chunk_pos;
+			chunk = find_chunk(glm::ivec2(cell.x, cell.z));
+			chunk_valid = true;
 		}
 
-		dx += 1;
-		if (dx > dimensions.x)
-			dx = dimensions.x;
+		// Chunks which do not exist, or which the ray passes above, are
+		// left through the side crossed first
+		const float exit_x = get_line_distance(0,
+				(chunk_pos.x + (step.x > 0 ? 1 : 0)) * WIDTH);
+		const float exit_z = get_line_distance(2,
+				(chunk_pos.y + (step.z > 0 ? 1 : 0)) * DEPTH);
+		const float exit_t = std::min(exit_x, exit_z);
+		if (chunk == nullptr or std::min(origin.y + direction.y*t,
+					origin.y + direction.y*exit_t) >= chunk->max_height) {
+			if (exit_t > max_distance)
+				break;
+			const int axis = exit_x <= exit_z ? 0 : 2;
+			const int other = 2 - axis;
+			const glm::ivec3 chunk_beg(
+					chunk_pos.x * WIDTH, 0, chunk_pos.y * DEPTH);
+			const glm::ivec3 chunk_dim(WIDTH, HEIGHT, DEPTH);
+			t = exit_t;
+			cell[axis] = step[axis] > 0 ?
+				chunk_beg[axis] + chunk_dim[axis] : chunk_beg[axis] - 1;
+			cell[other] = std::clamp<int>(
+					std::floor(origin[other] + direction[other]*t),
+					chunk_beg[other], chunk_beg[other] + chunk_dim[other] - 1);
+			cell.y = std::floor(origin.y + direction.y*t);
+			normal = glm::ivec3(0);
+			normal[axis] = -step[axis];
+			reset_t_max();
+			continue;
+		}
+
+		// Blocks above the column's height are empty
+		const int local_x = cell.x - chunk_pos.x * WIDTH;
+		const int local_z = cell.z - chunk_pos.y * DEPTH;
+		if (0 <= cell.y and cell.y < chunk->heights[local_x][local_z]) {
+			const block_type type = chunk->content[local_x][cell.y][local_z];
+			if (type != block_type::none) {
+				hit.type = type;
+				hit.block_pos = cell;
+				hit.normal = normal;
+				hit.distance = t;
+				return hit;
+			}
+		}
+
+		// On ties x goes first, then y
+		int axis = 0;
+		if (t_max[1] < t_max[axis])
+			axis = 1;
+		if (t_max[2] < t_max[axis])
+			axis = 2;
+		t = t_max[axis];
+		cell[axis] += step[axis];
+		t_max[axis] += t_delta[axis];
+		normal = glm::ivec3(0);
+		normal[axis] = -step[axis];
 	}
-	return false;
+	return hit;
+}
+
+void world_buffer_t::raycast(const std::vector<ray_t> &rays,
+		std::vector<raycast_hit_t> &hits) const {
+	hits.resize(rays.size());
+	#pragma omp parallel for schedule (dynamic, 64)
+	for (std::size_t i = 0; i < rays.size(); ++i)
+		hits[i] = raycast(rays[i].origin, rays[i].direction,
+				rays[i].max_distance);
 }
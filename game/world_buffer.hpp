@@ -6,12 +6,28 @@
 #define WORLD_BUFFER_HPP
 
 #include <map>
+#include <vector>
 #include <functional>
 
 #include <expiration_queue.hpp>
 #include "chunk.hpp"
 
 struct world_buffer_t {
+	struct ray_t {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float max_distance;
+	};
+	struct raycast_hit_t {
+		// block_type::none if no block has been hit
+		block_type type = block_type::none;
+		// Not wrapped along x, so that it lies on the ray
+		glm::ivec3 block_pos = glm::ivec3(0);
+		// Normal of the hit face, zero if the ray starts inside the block
+		glm::ivec3 normal = glm::ivec3(0);
+		float distance = 0.0f;
+	};
+
     // Data
 	std::map<glm::ivec2, chunk_t, vec2_cmp_t<int>> chunks;
 
@@ -26,15 +42,39 @@ struct world_buffer_t {
     inline int get_world_depth() const;
 
 	inline block_type& get(glm::ivec3 pos);
+	// Same as above, but blocks of chunks which do not exist are empty.
+	// Does not modify the buffer, so it is safe to call from many threads.
+	inline block_type get_if_exists(glm::ivec3 pos) const;
+	// Heights of the columns at world XZ positions, see `chunk_t`.
+	// Columns of chunks which do not exist are empty, the buffer is not
+	// modified.
+	inline int get_height(glm::ivec2 pos_XZ) const;
+	inline int get_ground_height(glm::ivec2 pos_XZ) const;
 	inline void for_each_active_chunk(const std::function<void(chunk_t&)> f);
 
 	// `pos` - Right-bottom-front rectangle position
 	// `dimensions` - POSITIVE rectangle dimensions in XY plane
-	// Returns `true` if rect intersects with blocks
-	// 	different than block_type::none, `false` otherwise
-	bool collision_check_XY_rect(glm::vec3 pos, glm::vec2 dimensions);
+	// Moves the rectangle by `offset` until it hits blocks, separately
+	// along each axis. The motion is swept over the block grid, so the cost
+	// depends on the number of crossed blocks only. Returns on which axes
+	// the rectangle has collided.
+	glm::bvec2 move_XY_rect(glm::vec3 &pos, glm::vec2 dimensions,
+			glm::vec2 offset) const;
+
+	// Finds the first block different than block_type::none along the ray,
+	// no further than `max_distance`. Blocks are traversed in the order
+	// they are crossed, chunks which do not exist or which the ray passes
+	// above are skipped at once. Safe to call from many threads.
+	raycast_hit_t raycast(glm::vec3 origin, glm::vec3 direction,
+			float max_distance) const;
+	// Same as above for many rays, in parallel
+	void raycast(const std::vector<ray_t> &rays,
+			std::vector<raycast_hit_t> &hits) const;
 
 private:
+	// Chunk containing the world XZ position, nullptr if it does not exist
+	inline const chunk_t* find_chunk(glm::ivec2 pos_XZ) const;
+
 	// World dimensions in chunks
     int width = 0;
     int height = 0;
@@ -75,4 +115,43 @@ inline block_type& world_buffer_t::get(glm::ivec3 pos) {
 		: void_block;
 }
 
+inline block_type world_buffer_t::get_if_exists(glm::ivec3 pos) const {
+	if (pos.y < 0 || pos.y >= static_cast<int>(chunk_t::HEIGHT))
+		return block_type::none;
+	const chunk_t * const chunk = find_chunk(glm::ivec2(pos.x, pos.z));
+	if (chunk == nullptr)
+		return block_type::none;
+	return chunk->content AT3_M(
+			pos.x, pos.y, pos.z,
+			chunk_t::WIDTH, chunk_t::HEIGHT, chunk_t::DEPTH);
+}
+
+inline int world_buffer_t::get_height(glm::ivec2 pos_XZ) const {
+	const chunk_t * const chunk = find_chunk(pos_XZ);
+	if (chunk == nullptr)
+		return 0;
+	return chunk->get_height(
+			(pos_XZ.x % chunk_t::WIDTH + chunk_t::WIDTH) % chunk_t::WIDTH,
+			(pos_XZ.y % chunk_t::DEPTH + chunk_t::DEPTH) % chunk_t::DEPTH);
+}
+
+inline int world_buffer_t::get_ground_height(glm::ivec2 pos_XZ) const {
+	const chunk_t * const chunk = find_chunk(pos_XZ);
+	if (chunk == nullptr)
+		return 0;
+	return chunk->get_ground_height(
+			(pos_XZ.x % chunk_t::WIDTH + chunk_t::WIDTH) % chunk_t::WIDTH,
+			(pos_XZ.y % chunk_t::DEPTH + chunk_t::DEPTH) % chunk_t::DEPTH);
+}
+
+inline const chunk_t* world_buffer_t::find_chunk(glm::ivec2 pos_XZ) const {
+	glm::ivec2 chunk_pos(
+		floor_div(pos_XZ.x, static_cast<int>(chunk_t::WIDTH)) % width,
+		floor_div(pos_XZ.y, static_cast<int>(chunk_t::DEPTH)));
+	if (chunk_pos.x < 0)
+		chunk_pos.x += width;
+	const auto it = chunks.find(chunk_pos);
+	return it == chunks.end() ? nullptr : &it->second;
+}
+
 #endif
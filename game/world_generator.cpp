@@ -2,7 +2,7 @@
 // GNU General Public License v3.0+ (see LICENSE.txt or https://www.gnu.org/licenses/gpl-3.0.txt)
 
 #include "world_generator.hpp"
-#include <random>
+#include <cstring>
 
 world_generator_t::world_generator_t(
 		map_storage_t &map_storage,
@@ -17,65 +17,142 @@ void world_generator_t::load_settings() {
 	noise.border_end = float(buffer.get_buffer_width()*chunk_t::WIDTH) * noise_pos_mult;
 	noise.border_beg = noise.border_end;
 	noise.border_beg -= float(chunk_t::WIDTH)*0.5 * noise_pos_mult;
-    random_generator = std::mt19937(1234);
     terrain_height = global_settings.terrain_height_in_blocks;
     assert(terrain_height <= chunk_t::HEIGHT);
+	generated_chunks.clear();
+	decoration_queues.clear();
+}
+
+void world_generator_t::set_map_tiles(map_tiles_t *map_tiles) {
+	this->map_tiles = map_tiles;
 }
 
 void world_generator_t::gen_chunk(const glm::ivec2 &chunk_pos) {
 	chunk_t &chunk = buffer.chunks[chunk_pos];
+	constexpr int WIDTH = chunk_t::WIDTH;
+	constexpr int HEIGHT = chunk_t::HEIGHT;
+	constexpr int DEPTH = chunk_t::DEPTH;
 
-	for (int x = 0; x < static_cast<int>(chunk.WIDTH); ++x) {
-		for (int z = 0; z < static_cast<int>(chunk.DEPTH); ++z) {
+	// Heights are read a map row at a time and stored transposed, so that
+	// both the reads and the fill below go with unit stride
+	uint8_t heights[WIDTH][DEPTH];
+	const int beg_map_x = chunk_pos.x*WIDTH;
+	for (int z = 0; z < DEPTH; ++z) {
+		const int map_y = z + chunk_pos.y*DEPTH;
+		if (map_tiles) {
+			// Tiles hold only the elevation byte in the alpha channel
+			for (int x = 0; x < WIDTH; ++x)
+				heights[x][z] = get_terrain_height(
+					(float)map_tiles->get_component_value(
+						map_y, beg_map_x + x, 3) / 255.0f);
+		} else {
+			const uint16_t * const row
+				= map_storage.get_elevation_row_pointer(map_y) + beg_map_x;
+			for (int x = 0; x < WIDTH; ++x)
+				heights[x][z] = get_terrain_height((float)row[x]
+						/ (float)map_storage_t::MAX_ELEVATION);
+		}
+	}
 
-			// const float p =
-			// 	(1.0f+perlin(
-			// 	(float)(x + chunk_pos.x*chunk.WIDTH)/(float)chunk.WIDTH*8.0f,
-			// 	(float)(z + chunk_pos.y*chunk.DEPTH)/(float)chunk.DEPTH*8.0f
-			// 	))/2.0f ;
-			// const float p = noise.octave2D_01(
-			// 	(float)(x + chunk_pos.x*chunk.WIDTH)*noise_pos_mult,
-			// 	(float)(z + chunk_pos.y*chunk.DEPTH)*noise_pos_mult,
-			// 	2
-			// );
-			const float p = (float)map_storage.get_component_value(
-				z + chunk_pos.y*chunk.DEPTH,
-				x + chunk_pos.x*chunk.WIDTH,
-				3) / 255.0f;
+	// Blocks of a given x and y lie contiguously along z. Layers below
+	// the lowest column and above the highest one are filled at once.
+	chunk.max_height = 0;
+	for (int x = 0; x < WIDTH; ++x) {
+		const uint8_t * const column_heights = heights[x];
+		const auto [min_height, max_height] = std::minmax_element(
+				column_heights, column_heights + DEPTH);
+		block_type (* const slice)[DEPTH] = chunk.content[x];
 
-			// int y = ( (p*3.0-1.0) * static_cast<float>(terrain_height) );
-			int y = ( (p) * static_cast<float>(terrain_height) ) + 1;
-			y = std::min(y, terrain_height-1);
+		std::memset(slice, static_cast<uint8_t>(block_type::sand),
+				(*min_height + 1)*DEPTH);
+		for (int y = *min_height + 1; y <= *max_height; ++y) {
+			uint8_t * const layer = reinterpret_cast<uint8_t*>(slice[y]);
+			for (int z = 0; z < DEPTH; ++z)
+				layer[z] = uint8_t(y <= column_heights[z])
+					* static_cast<uint8_t>(block_type::sand);
+		}
+		std::memset(slice[*max_height + 1],
+				static_cast<uint8_t>(block_type::none),
+				(HEIGHT - *max_height - 1)*DEPTH);
 
-            if (
-                std::uniform_int_distribution<int>(1, 1000)(random_generator) <= 1 and
-                y >= terrain_height/2)
-                place_cactus(chunk, x, y+1, z);
+		for (int z = 0; z < DEPTH; ++z)
+			chunk.heights[x][z] = chunk.ground_heights[x][z]
+				= column_heights[z] + 1;
+		chunk.max_height = std::max<int>(chunk.max_height, *max_height + 1);
+	}
 
-			while (y >= 0)
-                chunk.set_block(x, y--, z, block_type::sand);
+	// Decorations are placed after all columns are filled, so that
+	// a column does not overwrite the neighboring decorations. Blocks
+	// queued by the already generated neighbors come first.
+	generated_chunks.insert(chunk_pos);
+	apply_decoration_queue(chunk_pos, chunk);
+	const int beg_map_y = chunk_pos.y*DEPTH;
+	for (int x = 0; x < WIDTH; ++x) {
+		for (int z = 0; z < DEPTH; ++z) {
+			const uint32_t hash = hash_column(beg_map_x + x, beg_map_y + z);
+			const int y = heights[x][z];
+			if (hash % 1000 == 0 and y >= terrain_height/2)
+				place_cactus({beg_map_x + x, y+1, beg_map_y + z}, hash >> 31);
 		}
 	}
 }
 
-void world_generator_t::place_cactus(chunk_t &chunk, int x, int y, int z) {
-    chunk.set_block(x, y, z, block_type::cactus);
-    chunk.set_block(x, y+1, z, block_type::cactus);
+void world_generator_t::place_decoration_block(
+		glm::ivec3 world_pos, block_type type) {
+	if (world_pos.y < 0 or world_pos.y >= chunk_t::HEIGHT)
+		return;
+	// The world is cyclic along x only
+	glm::ivec2 chunk_pos(
+		floor_div(world_pos.x, chunk_t::WIDTH),
+		floor_div(world_pos.z, chunk_t::DEPTH));
+	if (chunk_pos.y < 0 or chunk_pos.y >= buffer.get_buffer_depth())
+		return;
+	const int x = world_pos.x - chunk_pos.x*chunk_t::WIDTH;
+	const int z = world_pos.z - chunk_pos.y*chunk_t::DEPTH;
+	chunk_pos.x %= buffer.get_buffer_width();
+	if (chunk_pos.x < 0)
+		chunk_pos.x += buffer.get_buffer_width();
+
+	if (generated_chunks.count(chunk_pos))
+		buffer.chunks[chunk_pos].set_block(x, world_pos.y, z, type);
+	else
+		decoration_queues[chunk_pos].push_back({
+			static_cast<uint8_t>(x),
+			static_cast<uint8_t>(world_pos.y),
+			static_cast<uint8_t>(z),
+			type});
+}
+
+void world_generator_t::apply_decoration_queue(
+		const glm::ivec2 &chunk_pos, chunk_t &chunk) {
+	const auto it = decoration_queues.find(chunk_pos);
+	if (it == decoration_queues.end())
+		return;
+	for (const decoration_block_t &block : it->second)
+		chunk.set_block(block.x, block.y, block.z, block.type);
+	decoration_queues.erase(it);
+}
 
-    const int direction = std::uniform_int_distribution<int>(0, 1)(random_generator);
+void world_generator_t::place_cactus(glm::ivec3 world_pos, int direction) {
+	const auto block = [this, &world_pos] (int dx, int dy, int dz) {
+		place_decoration_block(world_pos + glm::ivec3(dx, dy, dz),
+				block_type::cactus);
+	};
+    block(0, 0, 0);
+    block(0, 1, 0);
 
     switch (direction) {
         case 0:
-            chunk.set_block(x-1, y+1, z, block_type::cactus);
-            chunk.set_block(x+1, y+1, z, block_type::cactus);
-            chunk.set_block(x-1, y+2, z, block_type::cactus);
-            chunk.set_block(x+1, y+2, z, block_type::cactus);
+            block(-1, 1, 0);
+            block(1, 1, 0);
+            block(-1, 2, 0);
+            block(1, 2, 0);
             break;
         case 1:
-            chunk.set_block(x, y+1, z-1, block_type::cactus);
-            chunk.set_block(x, y+1, z+1, block_type::cactus);
-            chunk.set_block(x, y+2, z-1, block_type::cactus);
-            chunk.set_block(x, y+2, z+1, block_type::cactus);
+            block(0, 1, -1);
+            block(0, 1, 1);
+            block(0, 2, -1);
+            block(0, 2, 1);
             break;
     }
 }
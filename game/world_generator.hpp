@@ -5,12 +5,16 @@
 #ifndef WORLD_GENERATOR_HPP
 #define WORLD_GENERATOR_HPP
 
-#include <random>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include "world_buffer.hpp"
 #include "chunk.hpp"
 #include "map_generator/noise.hpp"
 #include "map_generator/map_storage.hpp"
+#include "map_generator/map_tiles.hpp"
 
 #include <useful.hpp>
 
@@ -20,19 +24,59 @@ struct world_generator_t {
 		world_buffer_t &buffer);
 
     void load_settings();
+	// If set, the map is read from the tiles instead of the map storage
+	void set_map_tiles(map_tiles_t *map_tiles);
 
+	// Decorations reaching chunks which are not generated yet are queued
+	// and applied when these chunks are generated
 	void gen_chunk(const glm::ivec2 &chunk_pos);
 
 	float noise_pos_mult = 1.0/512.0*8.0;
 
 private:
-    void place_cactus(chunk_t &chunk, int x, int y, int z);
+	// Block of a decoration, given in its target chunk's coordinates
+	struct decoration_block_t {
+		uint8_t x, y, z;
+		block_type type;
+	};
+
+	// Writes the block into its chunk if the chunk is generated already,
+	// queues it otherwise. Blocks outside of the world are dropped.
+	void place_decoration_block(glm::ivec3 world_pos, block_type type);
+	void apply_decoration_queue(const glm::ivec2 &chunk_pos, chunk_t &chunk);
+	// World position of the bottom block, direction is 0 or 1
+    void place_cactus(glm::ivec3 world_pos, int direction);
+	// Height of the highest block of a column, elevation lies in [0, 1]
+	inline int get_terrain_height(float elevation) const;
+	// Decorations depend only on the hash of their column, so chunks can
+	// be generated in any order
+	static inline uint32_t hash_column(int map_x, int map_y);
 
 	map_storage_t &map_storage;
+	map_tiles_t *map_tiles = nullptr;
 	world_buffer_t &buffer;
 	cyclic_noise_t noise;
-    std::mt19937 random_generator;
     int terrain_height;
+
+	std::set<glm::ivec2, vec2_cmp_t<int>> generated_chunks;
+	std::map<glm::ivec2, std::vector<decoration_block_t>, vec2_cmp_t<int>>
+		decoration_queues;
 };
 
+inline int world_generator_t::get_terrain_height(float elevation) const {
+	const int y = elevation * static_cast<float>(terrain_height) + 1;
+	return std::min(y, terrain_height-1);
+}
+
+inline uint32_t world_generator_t::hash_column(int map_x, int map_y) {
+	// Finalizer of MurmurHash3 applied to the packed coordinates
+	uint32_t hash = uint32_t(map_x) * 0x9e3779b1u ^ uint32_t(map_y);
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
 #endif
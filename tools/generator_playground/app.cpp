@@ -17,6 +17,7 @@ using namespace glm;
 app_t::app_t()
 	:callbacks_strct(window_width, window_height)
 	,map_generator(&map_storage)
+	,map_regenerator(map_storage)
 { }
 
 // Init
@@ -46,8 +47,13 @@ void app_t::loop() {
 			soft_reload_procedure();
 		}
 
-        if (global_settings.dynamic_map)
+        if (global_settings.dynamic_map and not map_regenerator.is_busy())
             reload_procedure();
+		if (map_regenerator.update()) {
+			// The storage's content no longer matches map_generator's state
+			map_generator.invalidate_map();
+			map_from_regenerator = true;
+		}
 
 		in_loop_parse_input();
 
@@ -63,7 +69,9 @@ void app_t::loop() {
             / 1000.0;
         timer_fps_cnter = now;
 
-        global_settings.supply_new_replace_seed(map_generator.get_current_voronoi_seed());
+        global_settings.supply_new_replace_seed(map_from_regenerator
+                ? map_regenerator.get_front_voronoi_seed()
+                : map_generator.get_current_voronoi_seed());
 
         if (global_settings.is_global_reload_pending())
             glfwSetWindowShouldClose(window, GLFW_TRUE);
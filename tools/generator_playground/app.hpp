@@ -11,6 +11,7 @@
 #include <glm/glm.hpp>
 
 #include "map_generator/map_generator.hpp"
+#include "map_generator/map_regenerator.hpp"
 #include "line.hpp"
 
 struct callbacks_strct_t {
@@ -42,6 +43,8 @@ private:
 	void in_loop_parse_input();
 	void in_loop_update_imgui();
 	void in_loop_draw_map();
+	// Shows a coarse level of the map being generated
+	void draw_map_level_frame();
 
 	void deinit_opengl_etc();
 	void deinit_imgui();
@@ -59,6 +62,11 @@ private:
 
 	map_storage_t map_storage;
 	map_generator_t map_generator;
+	// New maps are generated in the background, except for the GPU generator
+	map_regenerator_t map_regenerator;
+	// The map shown was swapped in by map_regenerator, not generated by
+	// map_generator
+	bool map_from_regenerator = false;
 	line_t line;
 	double line_off = 0;
 	glm::vec3 camera_pos = {0, 0, 0};
@@ -19,6 +19,10 @@ void app_t::init_map_generator() {
 
 	map_generator.load_settings();
 	map_generator.init_gl();
+	map_generator.set_map_level_callback([this] (int) {
+		map_storage.load_from_cpu_to_gpu_memory();
+		draw_map_level_frame();
+	});
 
 	line.init();
 
@@ -37,6 +41,7 @@ void app_t::in_loop_draw_map() {
 	// Drawing the line (player)
 	if (global_settings.draw_player and
 			not global_settings.generate_with_gpu and
+			not map_from_regenerator and
 			map_generator.are_tour_path_points_generated()) {
 		mat4 MVP(1);
 		MVP = scale(MVP, vec3(camera_zoom));
@@ -59,7 +64,13 @@ void app_t::in_loop_draw_map() {
 			0, 0, 1, 0,
 			0, 0, 0, 1,
 		};
-		world_pos.x /= map_generator.get_space_max().x*3.0;
+		if (map_generator.is_map_single_copy()) {
+			// Only the middle one third is stored, the rest wraps onto it
+			world_pos.x /= map_generator.get_space_max().x;
+			world_pos.x -= std::floor(world_pos.x);
+		} else {
+			world_pos.x /= map_generator.get_space_max().x*3.0;
+		}
 		world_pos.y /= map_generator.get_space_max().y;
 		world_pos.y = 1.0 - world_pos.y;
 		world_pos *= 2.0;
@@ -74,6 +85,14 @@ void app_t::in_loop_draw_map() {
 	}
 }
 
+void app_t::draw_map_level_frame() {
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glViewport(0, 0, window_width, window_height);
+	map_storage.draw(MVPb);
+	glfwSwapBuffers(window);
+}
+
 void app_t::deinit_map_generator() {
 	map_generator.deinit_gl();
 	map_storage.deinit_gl();
@@ -85,12 +104,22 @@ void app_t::soft_reload_procedure() {
 	map_storage.reallocate_gpu_and_cpu_memory();
 	map_generator.load_settings();
 	map_generator.generate_map();
+	map_from_regenerator = false;
 };
 
 void app_t::reload_procedure() {
+	// The GPU generator needs this thread's OpenGL context, the others
+	// run in the background and replace the map once finished
+	if (not global_settings.generate_with_gpu
+			or global_settings.emulate_gpu_on_cpu) {
+		map_regenerator.request();
+		return;
+	}
+
 	map_storage.load_settings();
 	map_storage.reallocate_gpu_and_cpu_memory();
 	map_generator.load_settings();
 	map_generator.new_seed();
 	map_generator.generate_map();
+	map_from_regenerator = false;
 };